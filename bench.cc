@@ -0,0 +1,66 @@
+#ifndef BENCH_CC
+#define BENCH_CC
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace NBench {
+    struct TBench {
+        const char* name;
+        void (*func)();
+    };
+
+    // Keep the compiler from throwing away a value computed only for timing.
+    template <typename T>
+    inline void DoNotOptimize(const T& value) {
+        asm volatile(""
+                     :
+                     : "r,m"(value)
+                     : "memory");
+    }
+
+    // Run fn() `iterations` times, print and return the mean time per call.
+    template <typename F>
+    double Measure(const char* name, size_t iterations, F&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            fn();
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+        double perOp = iterations ? ns / iterations : 0.0;
+        printf("  %-48s %12.2f ns/op (%zu ops)\n", name, perOp, iterations);
+        return perOp;
+    }
+
+    // Bytes currently allocated on the heap, 0 where it is not known.
+    inline size_t HeapInUse() {
+#ifdef __GLIBC__
+        struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd; // arena and mmapped chunks
+#else
+        return 0;
+#endif
+    }
+
+    // Usage: bench [substring...], run benchmarks whose name matches any filter.
+    inline int Main(const TBench* list, int argc, char** argv) {
+        for (const TBench* b = list; b->name != NULL; b++) {
+            bool selected = argc < 2;
+            for (int i = 1; i < argc && !selected; i++) {
+                selected = strstr(b->name, argv[i]) != NULL;
+            }
+            if (selected) {
+                printf("Bench %s...\n", b->name);
+                b->func();
+            }
+        }
+        return 0;
+    }
+} // namespace NBench
+
+#endif // #ifndef BENCH_CC
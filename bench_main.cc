@@ -0,0 +1,63 @@
+#ifndef RUN_BENCH
+#define RUN_BENCH
+#endif // RUN_BENCH
+
+#include <fstream>
+
+#include "bench.cc"
+#include "complex.cc"
+#include "fft.cc"
+#include "proc.cc"
+#include "expr.cc"
+#include "column.cc"
+#include "control.cc"
+#include "stats.cc"
+#include "tset.cc"
+
+// Where a -DCALC_STATS build leaves the STATS_SCOPE counters.
+#ifndef STATS_JSON
+#define STATS_JSON "bench_main.stats.json"
+#endif // #ifndef STATS_JSON
+
+static const NBench::TBench BENCH_LIST[] = {
+    // Complex
+    {"complex_pow", bench_complex_pow},
+    {"complex_parse", bench_complex_parse},
+    {"complex_div", bench_complex_div},
+    // FFT
+    {"fft_multiply", bench_fft_multiply},
+    // TMemory
+    {"pmemory_bank", bench_pmemory_bank},
+    // TProc
+    {"proc", bench_proc},
+    {"proc_div_zero", bench_proc_div_zero},
+    // Expressions
+    {"expr", bench_expr},
+    // Columns
+    {"column", bench_column},
+    // Editor
+    {"editor_insert", bench_editor_insert},
+    // History
+    {"history", bench_history},
+    {"history_log", bench_history_log},
+    // TCtrl
+    {"control_undo", bench_control_undo},
+    {"control_typing", bench_control_typing},
+    {"control_render", bench_control_render},
+    {"control_all_radices", bench_control_all_radices},
+    {"control_cache", bench_control_cache},
+    // TSet
+    {"tset", bench_tset},
+    {"tset_positional", bench_tset_positional},
+    // Stats
+    {"stats", bench_stats},
+    {NULL, NULL}};
+
+int main(int argc, char** argv) {
+    int ret = NBench::Main(BENCH_LIST, argc, argv);
+#ifdef CALC_STATS
+    std::ofstream(STATS_JSON) << NStats::DumpJson() << std::endl;
+    printf("Stats written to %s\n", STATS_JSON);
+#endif // #ifdef CALC_STATS
+    return ret;
+}
@@ -0,0 +1,281 @@
+#ifndef COLUMN_CC
+#define COLUMN_CC
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proc.cc"
+
+// Column at a time evaluation of TProc operation chains.
+namespace NColumn {
+    using NProc::TFunction;
+    using NProc::TOperation;
+
+    // Rows per tile, every step runs over one tile while it is in L1.
+    static const size_t COLUMN_TILE = 1024;
+    // Smallest row range worth a thread of its own.
+    static const size_t COLUMN_MIN_CHUNK = 64 * 1024;
+
+    struct TStep {
+        bool isFunction;
+        TOperation operation;
+        TFunction function;
+        size_t column;
+    };
+
+    // A fixed chain of steps applied to every row of an accumulator column:
+    // an operation step does acc = acc op columns[column] (TProc::OperationRun),
+    // a function step does acc = fn(acc) (TProc::FunctionRun).
+    // Division or Revert of zero leaves the row unchanged, as TProc does,
+    // and sets the row in the mask.
+    template <typename T = double>
+    class TBasicColumnProgram {
+    public:
+        TBasicColumnProgram& Then(TOperation operation, size_t column) {
+            switch (operation) {
+                case TOperation::None:
+                    return *this;
+                case TOperation::Add:
+                case TOperation::Sub:
+                case TOperation::Mul:
+                case TOperation::Div:
+                    break;
+                default:
+                    throw std::invalid_argument("Unsupported operation: " + std::to_string((int)operation));
+            }
+            steps.push_back({false, operation, TFunction::Sqr, column});
+            columns = std::max(columns, column + 1);
+            return *this;
+        }
+        TBasicColumnProgram& Then(TFunction function) {
+            if (function != TFunction::Revert && function != TFunction::Sqr) {
+                throw std::invalid_argument("Unsupported function: " + std::to_string((int)function));
+            }
+            steps.push_back({true, TOperation::None, function, 0});
+            return *this;
+        }
+
+        const std::vector<TStep>& GetSteps() const {
+            return steps;
+        }
+        // Operand columns Run() expects.
+        size_t GetColumns() const {
+            return columns;
+        }
+
+        // Runs the chain over acc in place, mask is resized to acc and
+        // mask[i] != 0 when row i met a zero divisor.
+        // threads == 0 uses all hardware threads.
+        void Run(std::vector<T>& acc, const std::vector<std::vector<T>>& operands,
+                 std::vector<uint8_t>& mask, size_t threads = 0) const {
+            if (operands.size() < columns) {
+                throw std::invalid_argument("Expected " + std::to_string(columns) +
+                                            " operand columns, got " + std::to_string(operands.size()));
+            }
+            std::vector<const T*> data;
+            for (size_t c = 0; c < columns; c++) {
+                if (operands[c].size() != acc.size()) {
+                    throw std::invalid_argument("Column " + std::to_string(c) + " has " +
+                                                std::to_string(operands[c].size()) + " rows, expected " +
+                                                std::to_string(acc.size()));
+                }
+                data.push_back(operands[c].data());
+            }
+            mask.assign(acc.size(), 0);
+
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threads = std::max<size_t>(1, std::min(threads, acc.size() / COLUMN_MIN_CHUNK));
+            auto runChunk = [&](size_t t) {
+                size_t from = acc.size() * t / threads;
+                size_t to = acc.size() * (t + 1) / threads;
+                for (size_t tile = from; tile < to; tile += COLUMN_TILE) {
+                    RunTile(acc.data(), data, mask.data(), tile, std::min(to, tile + COLUMN_TILE));
+                }
+            };
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < threads; t++) {
+                workers.emplace_back(runChunk, t);
+            }
+            runChunk(0);
+            for (auto& w : workers) {
+                w.join();
+            }
+        }
+
+    private:
+        // Branch free loops over [from, to), so the compiler can vectorise
+        // them; a zero divisor is masked out with a select.
+        void RunTile(T* acc, const std::vector<const T*>& data, uint8_t* mask, size_t from, size_t to) const {
+            for (const TStep& s : steps) {
+                if (s.isFunction) {
+                    if (s.function == TFunction::Sqr) {
+                        for (size_t i = from; i < to; i++) {
+                            acc[i] = acc[i] * acc[i];
+                        }
+                    } else {
+                        for (size_t i = from; i < to; i++) {
+                            bool zero = acc[i] == T(0);
+                            mask[i] |= zero;
+                            acc[i] = zero ? acc[i] : T(1) / acc[i];
+                        }
+                    }
+                    continue;
+                }
+                const T* b = data[s.column];
+                switch (s.operation) {
+                    case TOperation::Add:
+                        for (size_t i = from; i < to; i++) {
+                            acc[i] += b[i];
+                        }
+                        break;
+                    case TOperation::Sub:
+                        for (size_t i = from; i < to; i++) {
+                            acc[i] -= b[i];
+                        }
+                        break;
+                    case TOperation::Mul:
+                        for (size_t i = from; i < to; i++) {
+                            acc[i] *= b[i];
+                        }
+                        break;
+                    case TOperation::Div:
+                        for (size_t i = from; i < to; i++) {
+                            bool zero = b[i] == T(0);
+                            mask[i] |= zero;
+                            acc[i] = zero ? acc[i] : acc[i] / b[i];
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        std::vector<TStep> steps;
+        size_t columns = 0;
+    };
+
+    using TColumnProgram = TBasicColumnProgram<double>;
+} // namespace NColumn
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+
+void test_column() {
+    using namespace NColumn;
+    using NPNumber::TPNumber;
+    using NProc::TProc;
+
+    TEST_CASE("Steps");
+    {
+        TColumnProgram p;
+        p.Then(TOperation::Mul, 0).Then(TOperation::None, 5).Then(TOperation::Add, 1).Then(TFunction::Sqr);
+        TEST_CHECK(p.GetSteps().size() == 3 && p.GetColumns() == 2);
+        TEST_EXCEPTION(p.Then((TOperation)42, 0), std::invalid_argument);
+        TEST_EXCEPTION(p.Then((TFunction)42), std::invalid_argument);
+
+        std::vector<double> acc = {1, 2};
+        std::vector<uint8_t> mask;
+        TEST_EXCEPTION(p.Run(acc, {{1, 2}}, mask), std::invalid_argument);
+        TEST_EXCEPTION(p.Run(acc, {{1, 2}, {3}}, mask), std::invalid_argument);
+    }
+    TEST_CASE("Same results as TProc");
+    {
+        // long double is the TPNumber representation, results match exactly
+        TBasicColumnProgram<long double> p;
+        p.Then(TOperation::Mul, 0).Then(TOperation::Sub, 1).Then(TFunction::Sqr);
+        p.Then(TOperation::Div, 1).Then(TFunction::Revert).Then(TOperation::Add, 0);
+        size_t rows = 3 * COLUMN_MIN_CHUNK + 5;
+        std::vector<std::vector<long double>> operands(2, std::vector<long double>(rows));
+        std::vector<long double> acc(rows);
+        for (size_t i = 0; i < rows; i++) {
+            acc[i] = (long double)(i % 13) - 6;
+            operands[0][i] = (long double)(i % 7) / 4;
+            operands[1][i] = (long double)(i % 5) - 2; // zero divisor every fifth row
+        }
+        std::vector<long double> expect = acc;
+        std::vector<uint8_t> expectMask(rows, 0);
+        for (size_t i = 0; i < rows; i++) {
+            TProc proc(10, 4);
+            proc.SetLeftOp(TPNumber(expect[i], 10, 4));
+            for (const TStep& s : p.GetSteps()) {
+                if (s.isFunction) {
+                    proc.SetRightOp(proc.GetLeftOpRes());
+                    expectMask[i] |= proc.TryFunctionRun(s.function) != NNumber::TStatus::Ok;
+                    proc.SetLeftOp(proc.GetRightOp());
+                } else {
+                    proc.SetRightOp(TPNumber(operands[s.column][i], 10, 4));
+                    proc.SetOperation(s.operation);
+                    expectMask[i] |= proc.TryOperationRun() != NNumber::TStatus::Ok;
+                }
+            }
+            expect[i] = proc.GetLeftOpRes().GetNumber();
+        }
+
+        std::vector<uint8_t> mask;
+        p.Run(acc, operands, mask, 4);
+        bool same = true;
+        for (size_t i = 0; i < rows; i++) {
+            same = same && acc[i] == expect[i] && (mask[i] != 0) == (expectMask[i] != 0);
+        }
+        TEST_CHECK(same);
+        TEST_CHECK(mask[2] != 0 && mask[3] == 0);
+    }
+}
+#endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+
+// Mul, Add, Sqr, Div over a million rows, per row through TProc and
+// per column through TColumnProgram.
+void bench_column() {
+    using namespace NColumn;
+    using NPNumber::TPNumber;
+    const size_t rows = 1 << 20;
+    std::vector<std::vector<double>> operands(2, std::vector<double>(rows));
+    std::vector<double> acc(rows);
+    for (size_t i = 0; i < rows; i++) {
+        acc[i] = double(i % 13) - 6;
+        operands[0][i] = double(i % 7) / 4;
+        operands[1][i] = double(i % 5) - 2;
+    }
+    TColumnProgram p;
+    p.Then(TOperation::Mul, 0).Then(TOperation::Add, 1).Then(TFunction::Sqr).Then(TOperation::Div, 1);
+
+    NProc::TProc proc(10, 4);
+    NBench::Measure("TProc per row", 1, [&] {
+        for (size_t i = 0; i < rows; i++) {
+            proc.SetLeftOp(TPNumber(acc[i], 10, 4));
+            for (const TStep& s : p.GetSteps()) {
+                if (s.isFunction) {
+                    proc.SetRightOp(proc.GetLeftOpRes());
+                    proc.TryFunctionRun(s.function);
+                    proc.SetLeftOp(proc.GetRightOp());
+                } else {
+                    proc.SetRightOp(TPNumber(operands[s.column][i], 10, 4));
+                    proc.SetOperation(s.operation);
+                    proc.TryOperationRun();
+                }
+            }
+            NBench::DoNotOptimize(proc.GetLeftOpRes());
+        }
+    });
+    std::vector<uint8_t> mask;
+    for (size_t threads : {1, 2, 4, 8}) {
+        std::vector<double> work = acc;
+        std::string title = "TColumnProgram, threads " + std::to_string(threads);
+        NBench::Measure(title.c_str(), 1, [&] {
+            p.Run(work, operands, mask, threads);
+            NBench::DoNotOptimize(work[rows / 2]);
+        });
+    }
+}
+#endif // #ifdef RUN_BENCH
+#endif // #ifndef COLUMN_CC
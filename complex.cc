@@ -4,14 +4,27 @@
 #include <string>
 #include <sstream>
 #include <cstring>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 namespace NComplex {
-    double _uz(double v) {
+    template <typename T>
+    T _uz(T v) {
         if (v == 0.0 && std::signbit(v)) {
             return 0.0;
         }
         return v;
     }
+    template <typename T>
+    constexpr T _abs(T v) {
+        return v < 0 ? -v : v;
+    }
     class invalid_number : public std::invalid_argument {
     public:
         explicit invalid_number(const std::string& message)
@@ -19,157 +32,252 @@ namespace NComplex {
         }
     };
     static const char* DELIMITER = "+i*";
+    // Pow(n) switches from repeated squaring to the polar formula above
+    // this exponent: the ladder error grows with n while the polar one
+    // does not depend on the number of multiplies.
+    static const unsigned int POW_SQUARING_MAX = 1024;
+    // |n| * binary exponent of z must stay this far below the overflow
+    // exponent of T (2^1024 for double) on the squaring path.
+    static const long POW_SQUARING_EXP_MARGIN = 24;
+    // Numbers shorter than this are parsed from a stack copy, longer ones
+    // from a heap copy.
+    static const size_t PARSE_BUFFER_SIZE = 128;
+    // Do not spawn a parser thread for less than this number of records.
+    static const size_t PARSE_MIN_CHUNK = 4096;
+
+    // Complex number over float, double or long double.
+    // The arithmetic is constexpr, so constant expressions fold at compile time.
+    template <typename T>
+    class TBasicComplex {
+        static_assert(std::is_floating_point<T>::value, "TBasicComplex requires a floating point type");
 
-    class TComplex {
     public:
-        double Real;
-        double Imagn;
+        T Real;
+        T Imagn;
+
+        // pi to the precision of T, M_PI is a double
+        static constexpr T PI = T(3.141592653589793238462643383279502884L);
 
-        TComplex(double r, double i)
+        constexpr TBasicComplex(T r, T i)
             : Real(r)
             , Imagn(i) {
         }
 
-        TComplex(const TComplex& c)
+        constexpr TBasicComplex(const TBasicComplex& c)
             : Real(c.Real)
             , Imagn(c.Imagn) {
         }
 
-        explicit TComplex(std::string& c)
-            : Real(TComplex::parse_double(std::strtok(&c[0], DELIMITER)))
-            , Imagn(TComplex::parse_double(std::strtok(NULL, DELIMITER))) {
+        explicit TBasicComplex(const std::string& c)
+            : TBasicComplex(Parse(c)) {
         }
 
-        TComplex& operator=(const TComplex& rhs) {
+        constexpr TBasicComplex& operator=(const TBasicComplex& rhs) {
             Real = rhs.Real;
             Imagn = rhs.Imagn;
             return *this;
         }
 
-        TComplex operator+(const TComplex& rhs) const {
-            double re = Real + rhs.Real;
-            double im = Imagn + rhs.Imagn;
-            return TComplex(re, im);
+        constexpr TBasicComplex operator+(const TBasicComplex& rhs) const {
+            T re = Real + rhs.Real;
+            T im = Imagn + rhs.Imagn;
+            return TBasicComplex(re, im);
         }
 
-        TComplex operator-(const TComplex& rhs) const {
-            double re = Real - rhs.Real;
-            double im = Imagn - rhs.Imagn;
-            return TComplex(re, im);
+        constexpr TBasicComplex operator-(const TBasicComplex& rhs) const {
+            T re = Real - rhs.Real;
+            T im = Imagn - rhs.Imagn;
+            return TBasicComplex(re, im);
         }
 
-        TComplex operator*(const TComplex& rhs) const {
-            double re = Real * rhs.Real - Imagn * rhs.Imagn;
-            double im = Real * rhs.Imagn + Imagn * rhs.Real;
-            return TComplex(re, im);
+        constexpr TBasicComplex operator*(const TBasicComplex& rhs) const {
+            T re = Real * rhs.Real - Imagn * rhs.Imagn;
+            T im = Real * rhs.Imagn + Imagn * rhs.Real;
+            return TBasicComplex(re, im);
         }
 
-        TComplex operator/(const TComplex& rhs) const {
-            double delimiter = rhs.Norm();
-            double re = (Real * rhs.Real + Imagn * rhs.Imagn) / delimiter;
-            double im = (Imagn * rhs.Real - Real * rhs.Imagn) / delimiter;
-
-            //Case a=0.000000+i*9.300200, b=0.000000+i*0.000000: a/b=-nan+i*-nan != -nan+i*inf
-            if (Real == 0 && Imagn > 0 && rhs.Real == 0 && rhs.Imagn == 0) {
-                im = 1.0 / 0.0; // inf
-            }
-            //Case a=1.000000+i*0.000000, b=0.000000+i*0.000000: a/b=-nan+i*-nan != inf+i*-nan
-            if (Real > 0 && Imagn == 0 && rhs.Real == 0 && rhs.Imagn == 0) {
-                re = 1.0 / 0.0; // inf
+        constexpr TBasicComplex operator/(const TBasicComplex& rhs) const {
+            T re = 0, im = 0;
+            DivSmith(Real, Imagn, rhs.Real, rhs.Imagn, re, im);
+            // zero or infinite operands, rare and well predicted
+            if (re != re && im != im) {
+                DivRecover(Real, Imagn, rhs.Real, rhs.Imagn, re, im);
             }
+            return TBasicComplex(re, im);
+        }
 
-            return TComplex(re, im);
+        // Smith's division with Baudin's fallback for an underflowed ratio.
+        // The larger divisor component is picked by selects instead of
+        // branching on it and the norm of the divisor is never formed,
+        // so it neither overflows nor underflows for representable results.
+        static constexpr void DivSmith(T a, T b, T c, T d, T& re, T& im) {
+            bool swap = _abs(c) < _abs(d);
+            T p = swap ? d : c;
+            T q = swap ? c : d;
+            T x = swap ? b : a;
+            T y = swap ? a : b;
+            T sign = swap ? -1 : 1;
+            T r = q / p;
+            T den = p + q * r;
+            T xr = r != 0 ? x + y * r : x + q * (y / p);
+            T yr = r != 0 ? y - x * r : y - q * (x / p);
+            re = xr / den;
+            im = sign * yr / den;
         }
 
-        TComplex operator-() const {
-            return TComplex(-Real, -Imagn);
+        // Restore infinities and zeros that DivSmith computed as NaN+i*NaN,
+        // C99 Annex G (same as the compiler runtime does for std::complex).
+        static void DivRecover(T a, T b, T c, T d, T& re, T& im) {
+            const T inf = std::numeric_limits<T>::infinity();
+            if (c == 0 && d == 0 && (!std::isnan(a) || !std::isnan(b))) {
+                re = std::copysign(inf, c) * a;
+                im = std::copysign(inf, c) * b;
+            } else if ((std::isinf(a) || std::isinf(b)) && std::isfinite(c) && std::isfinite(d)) {
+                a = std::copysign(std::isinf(a) ? 1 : 0, a);
+                b = std::copysign(std::isinf(b) ? 1 : 0, b);
+                re = inf * (a * c + b * d);
+                im = inf * (b * c - a * d);
+            } else if ((std::isinf(c) || std::isinf(d)) && std::isfinite(a) && std::isfinite(b)) {
+                c = std::copysign(std::isinf(c) ? 1 : 0, c);
+                d = std::copysign(std::isinf(d) ? 1 : 0, d);
+                re = 0 * (a * c + b * d);
+                im = 0 * (b * c - a * d);
+            }
+        }
+
+        constexpr TBasicComplex operator-() const {
+            return TBasicComplex(-Real, -Imagn);
         }
 
-        TComplex operator!() const {
-            return TComplex(_uz(Real / Norm()), _uz(-(Imagn / Norm())));
+        TBasicComplex operator!() const {
+            return TBasicComplex(_uz(Real / Norm()), _uz(-(Imagn / Norm())));
         }
 
-        bool operator==(const TComplex& rhs) const {
+        constexpr bool IsZero() const {
+            return Real == 0 && Imagn == 0;
+        }
+        constexpr bool operator==(const TBasicComplex& rhs) const {
             return Real == rhs.Real && Imagn == rhs.Imagn;
         }
 
-        bool operator!=(const TComplex& rhs) const {
+        constexpr bool operator!=(const TBasicComplex& rhs) const {
             return !(*this == rhs);
         }
 
-        double AngleRad() const {
-            double sign = 1.0;
+        T AngleRad() const {
+            T sign = 1.0;
             if (std::signbit(Imagn)) {
                 sign = -1.0;
             }
             if (Real > 0) {
-                return atan(Imagn / Real);
+                return std::atan(Imagn / Real);
             } else if (Real < 0) {
-                return atan(Imagn / Real) + sign * M_PI;
+                return std::atan(Imagn / Real) + sign * PI;
             } else {
                 if (Imagn == 0) {
-                    double ret = 0.0;
+                    T ret = 0.0;
                     if (std::signbit(Real)) {
-                        ret = M_PI;
+                        ret = PI;
                     }
                     return sign * ret;
                 }
-                return sign * M_PI_2;
+                return sign * PI / 2;
             }
         }
 
-        double AngleDeg() const {
-            double sign = 1.0;
+        T AngleDeg() const {
+            T sign = 1.0;
             if (Imagn < 0.0) {
                 sign = -1.0;
             }
             if (Real == 0) {
-                return sign * 90.0;
+                return sign * 90;
             }
             if (Real > 0) {
-                return atan(Imagn / Real) * 360 / (2 * M_PI);
+                return std::atan(Imagn / Real) * 360 / (2 * PI);
             } else {
-                return (atan(Imagn / Real) + M_PI) * 360 / (2 * M_PI);
+                return (std::atan(Imagn / Real) + PI) * 360 / (2 * PI);
             }
         }
 
-        double Abs() const {
-            return sqrt(Real * Real + Imagn * Imagn);
+        T Abs() const {
+            return std::sqrt(Real * Real + Imagn * Imagn);
         }
 
-        double Norm() const {
+        constexpr T Norm() const {
             return Real * Real + Imagn * Imagn;
         }
 
-        TComplex Sqr() {
-            double re = Real * Real - Imagn * Imagn;
-            double im = Real * Imagn + Imagn * Real;
-            return TComplex(re, im);
+        constexpr TBasicComplex Sqr() const {
+            T re = Real * Real - Imagn * Imagn;
+            T im = Real * Imagn + Imagn * Real;
+            return TBasicComplex(re, im);
+        }
+
+        // Small exponents go through repeated squaring (exact for the
+        // first few powers and ~log2(n) multiplies), large ones or those
+        // whose intermediate products would leave the range of T fall
+        // back to the polar formula.
+        TBasicComplex Pow(int n) const {
+            if (n == 0) {
+                return TBasicComplex(1.0, 0.0);
+            }
+            unsigned int un = n < 0 ? -(unsigned int)n : (unsigned int)n;
+            if (un > POW_SQUARING_MAX) {
+                return PowPolar(n);
+            }
+            int exp = 0;
+            std::frexp(std::max(std::abs(Real), std::abs(Imagn)), &exp);
+            // |z|^n ~ 2^(n*exp): keep every intermediate product finite
+            long maxExp = std::numeric_limits<T>::max_exponent - POW_SQUARING_EXP_MARGIN;
+            if (std::abs(exp) * (long)un > maxExp) {
+                return PowPolar(n);
+            }
+            return PowSquaring(n);
+        }
+
+        constexpr TBasicComplex PowSquaring(int n) const {
+            unsigned int un = n < 0 ? -(unsigned int)n : (unsigned int)n;
+            TBasicComplex result(1.0, 0.0);
+            TBasicComplex base(*this);
+            while (un) {
+                if (un & 1) {
+                    result = result * base;
+                }
+                un >>= 1;
+                if (un) {
+                    base = base.Sqr();
+                }
+            }
+            if (n < 0) {
+                return TBasicComplex(1.0, 0.0) / result;
+            }
+            return result;
         }
 
-        TComplex Pow(int n) const {
-            double fi = AngleRad();
-            double md = Abs();
-            double re = pow(md, n) * (cos(n * fi));
-            double im = pow(md, n) * (sin(n * fi));
-            return TComplex(re, im);
+        TBasicComplex PowPolar(int n) const {
+            T fi = AngleRad();
+            T md = Abs();
+            T re = std::pow(md, n) * std::cos(n * fi);
+            T im = std::pow(md, n) * std::sin(n * fi);
+            return TBasicComplex(re, im);
         }
 
-        TComplex Root(int n, int i) const {
-            double fi = AngleRad();
-            double md = Abs();
-            double re = pow(md, 1 / n) * (cos((fi + 2 * (i - 1) * M_PI) / n));
-            double im = pow(md, 1 / n) * (sin((fi + 2 * (i - 1) * M_PI) / n));
-            return TComplex(re, im);
+        TBasicComplex Root(int n, int i) const {
+            T fi = AngleRad();
+            T md = Abs();
+            T re = std::pow(md, T(1) / n) * std::cos((fi + 2 * (i - 1) * PI) / n);
+            T im = std::pow(md, T(1) / n) * std::sin((fi + 2 * (i - 1) * PI) / n);
+            return TBasicComplex(re, im);
         }
 
         std::string GetRealAsStr() const {
-            double re = std::abs(Real) < 0.0000001 ? 0.0 : Real;
+            T re = std::abs(Real) < T(0.0000001) ? 0 : Real;
             return std::to_string(re);
         }
 
         std::string GetImagnAsStr() const {
-            double im = std::abs(Imagn) < 0.0000001 ? 0.0 : Imagn;
+            T im = std::abs(Imagn) < T(0.0000001) ? 0 : Imagn;
             return std::to_string(im);
         }
 
@@ -177,16 +285,132 @@ namespace NComplex {
             return GetRealAsStr() + "+i*" + GetImagnAsStr();
         }
 
+        // Parse "a+i*b" without touching the input and without hidden
+        // state, so it is safe to call from several threads at once.
+        static TBasicComplex Parse(std::string_view in) {
+            size_t delim = in.find(DELIMITER);
+            if (delim == std::string_view::npos) {
+                throw invalid_number(std::string(in));
+            }
+            return TBasicComplex(parse_number(in.substr(0, delim)),
+                                 parse_number(in.substr(delim + strlen(DELIMITER))));
+        }
+
     private:
-        double parse_double(char* in) {
+        static T parse_number(std::string_view in) {
+            // strtod needs a terminated string, copy to the stack when it fits
+            if (in.empty()) {
+                throw invalid_number(std::string(in));
+            }
+            char stack[PARSE_BUFFER_SIZE];
+            std::string heap;
+            char* buf = stack;
+            if (in.size() >= sizeof(stack)) {
+                heap.assign(in);
+                buf = heap.data();
+            } else {
+                memcpy(buf, in.data(), in.size());
+                buf[in.size()] = '\0';
+            }
             char* nend;
-            double n = strtod(in, &nend);
-            if (*nend != '\0') {
+            T n;
+            if constexpr (std::is_same<T, float>::value) {
+                n = strtof(buf, &nend);
+            } else if constexpr (std::is_same<T, double>::value) {
+                n = strtod(buf, &nend);
+            } else {
+                n = strtold(buf, &nend);
+            }
+            if (nend != buf + in.size()) {
                 throw invalid_number(std::string(in));
             }
             return n;
         }
-    }; // namespace TComplex
+    }; // class TBasicComplex
+
+    using TComplexF = TBasicComplex<float>;
+    using TComplex = TBasicComplex<double>;
+    using TComplexL = TBasicComplex<long double>;
+
+    template <typename T = double>
+    using TBasicComplexArray = std::vector<TBasicComplex<T>>;
+    using TComplexArray = TBasicComplexArray<double>;
+
+    // Element-wise lhs[i] / rhs[i]. The main loop is the branch-free Smith
+    // kernel only, so the compiler can vectorise it; NaN results of zero or
+    // infinite divisors are fixed up in a second pass.
+    template <typename T>
+    TBasicComplexArray<T> Divide(const TBasicComplexArray<T>& lhs, const TBasicComplexArray<T>& rhs) {
+        if (lhs.size() != rhs.size()) {
+            throw std::invalid_argument("Divide: size mismatch " + std::to_string(lhs.size()) +
+                                        " != " + std::to_string(rhs.size()));
+        }
+        TBasicComplexArray<T> result(lhs.size(), TBasicComplex<T>(0.0, 0.0));
+        const size_t size = lhs.size();
+        for (size_t i = 0; i < size; i++) {
+            TBasicComplex<T>::DivSmith(lhs[i].Real, lhs[i].Imagn, rhs[i].Real, rhs[i].Imagn,
+                                       result[i].Real, result[i].Imagn);
+        }
+        for (size_t i = 0; i < size; i++) {
+            TBasicComplex<T>& r = result[i];
+            if (r.Real != r.Real && r.Imagn != r.Imagn) {
+                TBasicComplex<T>::DivRecover(lhs[i].Real, lhs[i].Imagn, rhs[i].Real, rhs[i].Imagn,
+                                             r.Real, r.Imagn);
+            }
+        }
+        return result;
+    }
+
+    // Parse whitespace separated "a+i*b" records from buffer, the records are
+    // split into contiguous chunks and parsed on `threads` threads
+    // (0 - hardware concurrency). The first parse error is rethrown.
+    template <typename T = double>
+    TBasicComplexArray<T> ParseArray(std::string_view buffer, size_t threads = 0) {
+        static const char* SPACES = " \t\r\n";
+        std::vector<std::string_view> records;
+        size_t pos = buffer.find_first_not_of(SPACES);
+        while (pos != std::string_view::npos) {
+            size_t end = buffer.find_first_of(SPACES, pos);
+            if (end == std::string_view::npos) {
+                end = buffer.size();
+            }
+            records.push_back(buffer.substr(pos, end - pos));
+            pos = buffer.find_first_not_of(SPACES, end);
+        }
+
+        TBasicComplexArray<T> result(records.size(), TBasicComplex<T>(0.0, 0.0));
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = std::max<size_t>(1, std::min(threads, records.size() / PARSE_MIN_CHUNK));
+
+        std::vector<std::exception_ptr> errors(threads);
+        auto parseChunk = [&](size_t t) {
+            size_t from = records.size() * t / threads;
+            size_t to = records.size() * (t + 1) / threads;
+            try {
+                for (size_t i = from; i < to; i++) {
+                    result[i] = TBasicComplex<T>::Parse(records[i]);
+                }
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; t++) {
+            workers.emplace_back(parseChunk, t);
+        }
+        parseChunk(0);
+        for (auto& w : workers) {
+            w.join();
+        }
+        for (auto& e : errors) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+        return result;
+    }
 };     // namespace NComplex
 
 #ifdef RUN_TESTS
@@ -222,6 +446,44 @@ void test_complex_constructor() {
         string bad_i = "10+i*bla";
         TEST_EXCEPTION(new TComplex(bad_i), invalid_number);
     }
+    TEST_CASE("Parse");
+    {
+        const string in = "-1.5+i*2.25";
+        TComplex c = TComplex::Parse(in);
+        TEST_CHECK(c.Real == -1.5 && c.Imagn == 2.25);
+        TEST_CHECK(in == "-1.5+i*2.25"); // input is left untouched
+        string_view view = "7+i*-3 tail";
+        TEST_CHECK(TComplex::Parse(view.substr(0, 6)) == TComplex(7, -3));
+        TEST_EXCEPTION(TComplex::Parse("10.1"), invalid_number);
+        TEST_EXCEPTION(TComplex::Parse("+i*2"), invalid_number);
+        TEST_EXCEPTION(TComplex::Parse("1+i*"), invalid_number);
+        TEST_CHECK(TComplex::Parse(string(200, '1') + "+i*1") == TComplex(stod(string(200, '1')), 1));
+        string tiny = "0." + string(1000, '0') + "1";
+        TEST_CHECK(TComplexL::Parse("1+i*" + tiny).Imagn == stold(tiny) && stold(tiny) != 0);
+        TEST_EXCEPTION(TComplex::Parse(string(200, '1') + "x+i*1"), invalid_number);
+    }
+    TEST_CASE("ParseArray");
+    {
+        TEST_CHECK(ParseArray("").empty());
+        TComplexArray a = ParseArray(" 1+i*2\n-3.5+i*0.25\t\n0+i*-1 ");
+        TEST_CHECK(a.size() == 3);
+        TEST_CHECK(a[0] == TComplex(1, 2) && a[1] == TComplex(-3.5, 0.25) && a[2] == TComplex(0, -1));
+
+        string buffer;
+        size_t count = 4 * PARSE_MIN_CHUNK + 17;
+        for (size_t i = 0; i < count; i++) {
+            buffer += to_string(i) + "+i*-" + to_string(i / 2) + "\n";
+        }
+        TComplexArray b = ParseArray(buffer, 4);
+        TEST_CHECK(b.size() == count);
+        bool ok = true;
+        for (size_t i = 0; i < b.size(); i++) {
+            ok = ok && b[i] == TComplex(i, -double(i / 2));
+        }
+        TEST_CHECK(ok);
+        buffer += "1+i*bla\n";
+        TEST_EXCEPTION(ParseArray(buffer, 4), invalid_number);
+    }
     TEST_CASE("CopyConstructor");
     {
         const double r = 70.1;
@@ -345,6 +607,41 @@ void test_complex_operations() {
             }
         }
     }
+    TEST_CASE("Div without intermediate overflow");
+    {
+        TEST_CHECK(TComplex(1e300, 1e300) / TComplex(1e300, 1e300) == TComplex(1.0, 0.0));
+        TEST_CHECK(TComplex(1e-300, 1e-300) / TComplex(1e-300, 1e-300) == TComplex(1.0, 0.0));
+        TComplex r = TComplex(1e308, -1e308) / TComplex(2e307, 4e307);
+        complex<double> e = complex<double>(1e308, -1e308) / complex<double>(2e307, 4e307);
+        TEST_CHECK_(abs(r.Real - e.real()) < 1e-12 && abs(r.Imagn - e.imag()) < 1e-12,
+                    "%s != %g+i*%g", r.ToString().c_str(), e.real(), e.imag());
+        // ratio underflows to zero
+        r = TComplex(1.0, 1e-200) / TComplex(1e150, 1e-200);
+        TEST_CHECK(abs(r.Real / 1e-150 - 1.0) < 1e-15 && r.Imagn == 0.0);
+        // infinite operands
+        r = TComplex(INFINITY, 1.0) / TComplex(2.0, 0.0);
+        TEST_CHECK(std::isinf(r.Real));
+        r = TComplex(1.0, 1.0) / TComplex(INFINITY, 0.0);
+        TEST_CHECK(r.Real == 0.0 && r.Imagn == 0.0);
+    }
+    TEST_CASE("Divide arrays");
+    {
+        TComplexArray lhs, rhs;
+        for (auto& c : cases) {
+            lhs.push_back(c.first);
+            rhs.push_back(c.second);
+        }
+        TComplexArray r = Divide(lhs, rhs);
+        TEST_CHECK(r.size() == lhs.size());
+        for (size_t i = 0; i < r.size(); i++) {
+            TComplex e = lhs[i] / rhs[i];
+            if (not TEST_CHECK(r[i].ToString() == e.ToString())) {
+                TEST_MSG("Case %zu: %s != %s", i, r[i].ToString().c_str(), e.ToString().c_str());
+            }
+        }
+        rhs.pop_back();
+        TEST_EXCEPTION(Divide(lhs, rhs), std::invalid_argument);
+    }
     TEST_CASE("Sqr");
     {
         for (auto& c : cases) {
@@ -472,6 +769,34 @@ void test_complex_operations() {
         }
     }
 
+    TEST_CASE("Pow squaring and polar paths");
+    {
+        auto close = [](const TComplex& r, const complex<double>& e) {
+            double scale = max(1.0, abs(e));
+            return abs(r.Real - e.real()) <= 1e-9 * scale &&
+                   abs(r.Imagn - e.imag()) <= 1e-9 * scale;
+        };
+        TComplex z(0.9, -0.43); // |z| ~ 0.997
+        complex<double> zc(z.Real, z.Imagn);
+        for (int n : {1, 2, 3, 13, 64, 200, 1024, 1025, 3000, -1, -5, -70, -2000}) {
+            complex<double> e = pow(zc, n);
+            TComplex r = z.Pow(n);
+            if (not TEST_CHECK(close(r, e))) {
+                TEST_MSG("Case z=%s: z.Pow(%d)=%s != %f+i*%f",
+                         z.ToString().c_str(), n, r.ToString().c_str(), e.real(), e.imag());
+            }
+            TEST_CHECK(close(z.PowSquaring(n), e));
+            TEST_CHECK(close(z.PowPolar(n), e));
+        }
+        TEST_CHECK(z.Pow(0) == TComplex(1.0, 0.0));
+        // exact on the squaring path
+        TEST_CHECK(TComplex(1.0, 1.0).Pow(4) == TComplex(-4.0, 0.0));
+        TEST_CHECK(TComplex(0.0, 1.0).Pow(3) == TComplex(0.0, -1.0));
+        // out of the double range goes through the polar formula
+        TComplex big = TComplex(1e300, 1e300).Pow(5);
+        TEST_CHECK(std::isinf(big.Real) || std::isinf(big.Imagn));
+    }
+
     TEST_CASE("Sqr");
     {
         for (auto& c : cases) {
@@ -534,5 +859,201 @@ void test_complex_operations() {
         TEST_CHECK(c2.GetImagnAsStr() == "-1.000000");
     }
 }
+
+void test_complex_precision() {
+    using namespace NComplex;
+    TEST_CASE("Constexpr arithmetic");
+    {
+        constexpr TComplex a(1.0, 2.0);
+        constexpr TComplex b(3.0, -4.0);
+        static_assert(a + b == TComplex(4.0, -2.0), "constexpr add");
+        static_assert(a - b == TComplex(-2.0, 6.0), "constexpr sub");
+        static_assert(a * b == TComplex(11.0, 2.0), "constexpr mul");
+        static_assert(TComplex(11.0, 2.0) / b == a, "constexpr div");
+        static_assert(-a == TComplex(-1.0, -2.0), "constexpr neg");
+        static_assert(a.Sqr() == TComplex(-3.0, 4.0) && a.Norm() == 5.0, "constexpr sqr");
+        static_assert(TComplexF(0.0f, 1.0f).PowSquaring(4) == TComplexF(1.0f, 0.0f), "constexpr pow");
+        constexpr TComplexL c = TComplexL(0.5L, 0.5L) * TComplexL(2.0L, 0.0L);
+        static_assert(c == TComplexL(1.0L, 1.0L), "constexpr long double");
+        TEST_CHECK(c.Real == 1.0L);
+    }
+    TEST_CASE("Float and long double");
+    {
+        TComplexF f = TComplexF::Parse("1.5+i*-2");
+        TEST_CHECK(f.Real == 1.5f && f.Imagn == -2.0f);
+        TEST_CHECK(f.ToString() == "1.500000+i*-2.000000");
+        TEST_CHECK((f / f) == TComplexF(1.0f, 0.0f));
+        TEST_CHECK(std::abs(f.Abs() - 2.5f) < 1e-6f);
+
+        TComplexL l = TComplexL::Parse("0.1+i*0.2");
+        TEST_CHECK(l.Real == 0.1L && l.Imagn == 0.2L);
+        TComplexL p = l.Pow(3);
+        complex<long double> e = pow(complex<long double>(0.1L, 0.2L), 3);
+        TEST_CHECK(std::abs(p.Real - e.real()) < 1e-18L && std::abs(p.Imagn - e.imag()) < 1e-18L);
+
+        // no detour through double
+        TEST_CHECK(TComplexL(1.0L / 3, 0).Abs() == 1.0L / 3);
+        TEST_CHECK(TComplexL(-1, 0).AngleRad() == 3.141592653589793238462643383279502884L);
+        TComplexL r = TComplexL(0, 8).Root(3, 1);
+        TEST_CHECK(std::abs(r.Real - std::sqrt(3.0L)) < 1e-18L && std::abs(r.Imagn - 1) < 1e-18L);
+        TComplexL q = TComplexL(1.0L / 3, 1.0L / 7).PowPolar(5);
+        e = pow(complex<long double>(1.0L / 3, 1.0L / 7), 5);
+        TEST_CHECK(std::abs(q.Real - e.real()) < 1e-20L && std::abs(q.Imagn - e.imag()) < 1e-20L);
+
+        auto fa = ParseArray<float>("1+i*2 3+i*4");
+        TEST_CHECK(fa.size() == 2 && fa[1] == TComplexF(3.0f, 4.0f));
+    }
+}
 #endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include <complex>
+#include <random>
+#include <vector>
+
+void bench_complex_pow() {
+    using NComplex::TComplex;
+    std::vector<TComplex> zs;
+    for (int i = 0; i < 256; i++) {
+        zs.push_back(TComplex(0.5 + 0.004 * i, -1.0 + 0.008 * i));
+    }
+    for (int n : {2, 7, 16, 33, 64, 200, 1024}) {
+        // accuracy: max relative error against a long double reference
+        double errSq = 0, errPolar = 0, errStd = 0;
+        for (auto& z : zs) {
+            std::complex<long double> ref(1.0L, 0.0L), zl(z.Real, z.Imagn);
+            for (int k = 0; k < n; k++) {
+                ref *= zl;
+            }
+            long double scale = std::abs(ref);
+            auto err = [&](double re, double im) {
+                return (double)(std::abs(std::complex<long double>(re, im) - ref) / scale);
+            };
+            TComplex sq = z.PowSquaring(n);
+            TComplex pl = z.PowPolar(n);
+            std::complex<double> st = std::pow(std::complex<double>(z.Real, z.Imagn), n);
+            errSq = std::max(errSq, err(sq.Real, sq.Imagn));
+            errPolar = std::max(errPolar, err(pl.Real, pl.Imagn));
+            errStd = std::max(errStd, err(st.real(), st.imag()));
+        }
+        printf("  n=%-4d max rel. error: squaring %.3e, polar %.3e, std::pow %.3e\n",
+               n, errSq, errPolar, errStd);
+
+        size_t iters = 200000;
+        size_t i = 0;
+        char name[64];
+        snprintf(name, sizeof(name), "TComplex::Pow(%d)", n);
+        NBench::Measure(name, iters, [&] { NBench::DoNotOptimize(zs[i++ & 255].Pow(n)); });
+        snprintf(name, sizeof(name), "TComplex::PowSquaring(%d)", n);
+        NBench::Measure(name, iters, [&] { NBench::DoNotOptimize(zs[i++ & 255].PowSquaring(n)); });
+        snprintf(name, sizeof(name), "TComplex::PowPolar(%d)", n);
+        NBench::Measure(name, iters, [&] { NBench::DoNotOptimize(zs[i++ & 255].PowPolar(n)); });
+        snprintf(name, sizeof(name), "std::pow(std::complex<double>, %d)", n);
+        NBench::Measure(name, iters, [&] {
+            auto& z = zs[i++ & 255];
+            NBench::DoNotOptimize(std::pow(std::complex<double>(z.Real, z.Imagn), n));
+        });
+    }
+}
+
+void bench_complex_parse() {
+    using namespace NComplex;
+    std::string buffer;
+    const size_t count = 1000000;
+    for (size_t i = 0; i < count; i++) {
+        buffer += std::to_string(i * 0.37) + "+i*" + std::to_string(-(i * 1.13)) + "\n";
+    }
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < 1000; i++) {
+        lines.push_back(std::to_string(i * 0.37) + "+i*" + std::to_string(-(i * 1.13)));
+    }
+    size_t i = 0;
+    NBench::Measure("TComplex(std::string&)", count, [&] {
+        NBench::DoNotOptimize(TComplex(lines[i++ % lines.size()]));
+    });
+    NBench::Measure("TComplex::Parse(std::string_view)", count, [&] {
+        NBench::DoNotOptimize(TComplex::Parse(lines[i++ % lines.size()]));
+    });
+    for (size_t threads : {1, 2, 4, 8}) {
+        char name[64];
+        snprintf(name, sizeof(name), "ParseArray(10^6 records, %zu threads)", threads);
+        NBench::Measure(name, 1, [&] { NBench::DoNotOptimize(ParseArray(buffer, threads).size()); });
+    }
+}
+
+void bench_complex_div() {
+    using namespace NComplex;
+    std::mt19937_64 rng(42);
+    for (int spread : {4, 300}) {
+        // mantissa in [-1, 1), decimal exponent in [-spread, spread]
+        std::uniform_real_distribution<double> mant(-1.0, 1.0);
+        std::uniform_int_distribution<int> exp(-spread, spread);
+        auto rnd = [&] { return mant(rng) * std::pow(10.0, exp(rng)); };
+        const size_t count = 1 << 16;
+        TComplexArray lhs, rhs;
+        for (size_t i = 0; i < count; i++) {
+            lhs.push_back(TComplex(rnd(), rnd()));
+            rhs.push_back(TComplex(rnd(), rnd()));
+        }
+        auto naive = [](const TComplex& l, const TComplex& r) {
+            double n = r.Norm();
+            return TComplex((l.Real * r.Real + l.Imagn * r.Imagn) / n,
+                            (l.Imagn * r.Real - l.Real * r.Imagn) / n);
+        };
+
+        // accuracy against a long double reference, counts of results that
+        // are off by more than 1e-12 relative (including inf/nan/flushed zeros)
+        size_t badNaive = 0, badSmith = 0, badStd = 0;
+        double errNaive = 0, errSmith = 0, errStd = 0;
+        for (size_t i = 0; i < count; i++) {
+            std::complex<long double> ref = std::complex<long double>(lhs[i].Real, lhs[i].Imagn) /
+                                            std::complex<long double>(rhs[i].Real, rhs[i].Imagn);
+            if (std::abs(ref) > std::numeric_limits<double>::max() ||
+                std::abs(ref) < std::numeric_limits<double>::min()) {
+                continue; // not representable in double
+            }
+            auto err = [&](double re, double im, size_t& bad, double& worst) {
+                long double e = std::abs(std::complex<long double>(re, im) - ref) / std::abs(ref);
+                if (!(e <= 1e-12L)) {
+                    bad++;
+                } else {
+                    worst = std::max(worst, (double)e);
+                }
+            };
+            TComplex n = naive(lhs[i], rhs[i]);
+            TComplex sm = lhs[i] / rhs[i];
+            std::complex<double> st = std::complex<double>(lhs[i].Real, lhs[i].Imagn) /
+                                      std::complex<double>(rhs[i].Real, rhs[i].Imagn);
+            err(n.Real, n.Imagn, badNaive, errNaive);
+            err(sm.Real, sm.Imagn, badSmith, errSmith);
+            err(st.real(), st.imag(), badStd, errStd);
+        }
+        printf("  exponents +-%d: wrong results naive %zu, smith %zu, std %zu of %zu\n",
+               spread, badNaive, badSmith, badStd, count);
+        printf("  exponents +-%d: max rel. error naive %.3e, smith %.3e, std %.3e\n",
+               spread, errNaive, errSmith, errStd);
+
+        size_t i = 0;
+        const size_t mask = count - 1;
+        NBench::Measure("naive (l * conj(r)) / Norm(r)", count * 16, [&] {
+            NBench::DoNotOptimize(naive(lhs[i & mask], rhs[i & mask]));
+            i++;
+        });
+        NBench::Measure("TComplex::operator/", count * 16, [&] {
+            NBench::DoNotOptimize(lhs[i & mask] / rhs[i & mask]);
+            i++;
+        });
+        NBench::Measure("std::complex<double>::operator/", count * 16, [&] {
+            NBench::DoNotOptimize(std::complex<double>(lhs[i & mask].Real, lhs[i & mask].Imagn) /
+                                  std::complex<double>(rhs[i & mask].Real, rhs[i & mask].Imagn));
+            i++;
+        });
+        double perArray = NBench::Measure("Divide(TComplexArray) per array", 16, [&] {
+            NBench::DoNotOptimize(Divide(lhs, rhs).data());
+        });
+        printf("  %-48s %12.2f ns/op\n", "Divide(TComplexArray) per element", perArray / count);
+    }
+}
+#endif // #ifdef RUN_BENCH
 #endif // #ifdef COMPLEX_CC
@@ -1,19 +1,212 @@
 #ifndef TCTRL_CC
 #define TCTRL_CC
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
 #include "editor.cc"
 #include "proc.cc"
 #include "pmemory.cc"
 #include "pnumber.cc"
 #include "history.cc"
+#include "historylog.cc"
+#include "journal.cc"
+#include "lru.cc"
+#include "stats.cc"
 #include "const.cc"
 
 namespace NCtrl {
     using NEditor::invalid_digit;
     using NPNumber::TPNumber;
 
+    // TPNumber::ToString() that reuses its previous result: the same text
+    // for an unchanged number, and for an integer that only gained or lost
+    // trailing digits in a power of two radix just those digits redone.
+    class TRenderer {
+    public:
+        std::string Render(const TPNumber& n) {
+            if (radix == n.GetRadix() && precision == n.GetPrecision()) {
+                if (number == n.GetNumber()) {
+                    return text;
+                }
+                if (integral && RenderSuffix(n.GetNumber())) {
+                    return text;
+                }
+            }
+            return RenderFull(n);
+        }
+
+    private:
+        // Integers below 2^63, TPNumber::ToString renders them exactly.
+        static bool IsSmallIntegral(long double v) {
+            return std::isfinite(v) && std::fabs(v) < 0x1p63L && v == std::trunc(v);
+        }
+
+        std::string RenderFull(const TPNumber& n) {
+            text = n.ToString();
+            number = n.GetNumber();
+            radix = n.GetRadix();
+            precision = n.GetPrecision();
+            integral = (radix & (radix - 1)) == 0 && IsSmallIntegral(number);
+            if (integral) {
+                size_t begin = text[0] == NConst::MINUS;
+                digits = text.substr(begin, text.find(NConst::DOT) - begin);
+            }
+            return text;
+        }
+
+        // Output digits are groups of log2(radix) bits from the lowest, so
+        // when the new integer is the old one shifted by whole digits only
+        // the digits shifted in or out change.
+        bool RenderSuffix(long double v) {
+            if (!IsSmallIntegral(v)) {
+                return false;
+            }
+            const int bits = __builtin_ctz(radix);
+            uint64_t now = (uint64_t)std::fabs(v);
+            uint64_t was = (uint64_t)std::fabs(number);
+            size_t nowLen = now == 0 ? 1 : (64 - __builtin_clzll(now) + bits - 1) / bits;
+            size_t wasLen = was == 0 ? 0 : digits.size();
+            if (was == 0) {
+                digits.clear();
+            }
+            if (now == 0) {
+                digits = NConst::ZERO;
+            } else if (nowLen >= wasLen && Shr(now, bits * (nowLen - wasLen)) == was) {
+                for (size_t i = wasLen; i < nowLen; i++) {
+                    digits += NConst::ALPHABET[(now >> (bits * (nowLen - 1 - i))) & (radix - 1)];
+                }
+            } else if (nowLen < wasLen && Shr(was, bits * (wasLen - nowLen)) == now) {
+                digits.resize(nowLen);
+            } else {
+                return false;
+            }
+            number = v;
+            text.clear();
+            if (v < 0) {
+                text += NConst::MINUS;
+            }
+            text += digits;
+            if (precision > 0) {
+                text += NConst::DOT;
+                text.append(precision, NConst::ZERO);
+            }
+            return true;
+        }
+
+        // x >> n, 0 once all 64 bits are shifted out
+        static uint64_t Shr(uint64_t x, size_t n) {
+            return n < 64 ? x >> n : 0;
+        }
+
+        std::string text;
+        // integer digits of text when integral
+        std::string digits;
+        long double number = 0;
+        int radix = 0;
+        int precision = -1;
+        bool integral = false;
+    };
+
+    static const size_t PARSE_CACHE_CAPACITY = 256;
+
+    // What parsing depends on: the source text as the editor keeps it,
+    // less a trailing dot, and its radix.
+    struct TParseKey {
+        std::string source;
+        int radix;
+
+        bool operator==(const TParseKey& o) const {
+            return radix == o.radix && source == o.source;
+        }
+    };
+    struct TParseKeyHash {
+        size_t operator()(const TParseKey& k) const {
+            return std::hash<std::string>()(k.source) ^ k.radix * 0x9E3779B97F4A7C15ULL;
+        }
+    };
+
+    static const size_t CONVERSION_CACHE_CAPACITY = 256;
+
+    // What the output text depends on besides the number: the source
+    // text as the editor keeps it, less a trailing dot, and the settings.
+    struct TConversionKey {
+        std::string source;
+        int radixIn;
+        int radixOut;
+        int precision;
+        bool carry;
+
+        bool operator==(const TConversionKey& o) const {
+            return source == o.source && radixIn == o.radixIn && radixOut == o.radixOut &&
+                   precision == o.precision && carry == o.carry;
+        }
+    };
+    struct TConversionKeyHash {
+        size_t operator()(const TConversionKey& k) const {
+            size_t settings = (size_t)k.radixIn << 24 | (size_t)k.radixOut << 16 |
+                              (size_t)(k.precision & 0xFF) << 8 | k.carry;
+            return std::hash<std::string>()(k.source) ^ settings * 0x9E3779B97F4A7C15ULL;
+        }
+    };
+
+    // The output number and the key of its text, e.g. to render it on
+    // another thread.
+    struct TOutput {
+        TConversionKey key;
+        TPNumber number;
+    };
+
+    // Output texts of recent conversions, shared with the thread the Ui
+    // renders on: lookups are locked, rendering is not. A number typed
+    // key by key may differ from the parsed one in the last bit, so an
+    // entry is used only for the number it was rendered from.
+    class TConversionCache {
+    public:
+        std::string Render(const TOutput& o, TRenderer& renderer) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                const TConverted* c = entries.Get(o.key);
+                if (c != NULL && c->number == o.number.GetNumber()) {
+                    hits++;
+                    return c->text;
+                }
+                misses++;
+            }
+            std::string text = renderer.Render(o.number);
+            std::lock_guard<std::mutex> guard(lock);
+            entries.Put(o.key, {o.number.GetNumber(), text});
+            return text;
+        }
+
+        uint64_t GetHits() const {
+            std::lock_guard<std::mutex> guard(lock);
+            return hits;
+        }
+        uint64_t GetMisses() const {
+            std::lock_guard<std::mutex> guard(lock);
+            return misses;
+        }
+
+    private:
+        struct TConverted {
+            long double number;
+            std::string text;
+        };
+
+        mutable std::mutex lock;
+        NLru::TLruCache<TConversionKey, TConverted, TConversionKeyHash> entries{CONVERSION_CACHE_CAPACITY};
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
     class TCtrl {
     public:
         explicit TCtrl() {
+            Checkpoint();
         }
 
         void SetOutputPrecision(int p) {
@@ -32,6 +225,7 @@ namespace NCtrl {
 
         void SetSourceRadix(int radix) {
             radixIn = radix;
+            typed.synced = false;
         }
         int GetSourceRadix() {
             return radixIn;
@@ -43,33 +237,80 @@ namespace NCtrl {
         void Clear() {
             editor.Clear();
             number.SetNumber(0);
+            typed = TTyped();
         }
 
+        // Drops the last symbol in O(1) while the typed value is exact,
+        // otherwise re-parses the source.
         void Backspace() {
-            editor.Backspace();
-            ReSetNumber(editor.Get());
+            if (!typed.synced || !typed.IsExact()) {
+                editor.EraseBack();
+                ReSetNumber(editor.Get());
+                return;
+            }
+            char last = editor.Back();
+            editor.EraseBack();
+            if (last == NConst::MINUS) {
+                typed.negative = false;
+            } else if (last != NConst::DOT && last != '\0') {
+                int d = NConst::CharToIdx(last);
+                if (editor.HasDot()) {
+                    typed.fraction = (typed.fraction - d) / radixIn;
+                    typed.scale /= radixIn;
+                    typed.digits--;
+                } else {
+                    typed.integer = (typed.integer - d) / radixIn;
+                }
+            }
+            number.SetNumber(typed.Value(radixIn));
         }
 
         void AddSign() {
-            editor.AddSign();
+            editor.ToggleSign();
             number.SetNumber(-number.GetNumber());
+            typed.negative = !typed.negative;
         }
 
         void AddDot() {
-            editor.AddDot();
+            editor.InsertDot();
         }
 
+        // n = n * radix + d for the integer part, fraction digits extend
+        // the fraction and its scale; O(1) per key. The source is re-parsed
+        // only after a radix change, a paste or a restore.
         void AddDigit(char n) {
-            editor.AddDigit(n, radixIn);
-            ReSetNumber(editor.Get());
+            editor.InsertDigit(n, radixIn);
+            if (!typed.synced) {
+                ReSetNumber(editor.Get());
+                return;
+            }
+            int d = NConst::CharToIdx(n);
+            if (editor.HasDot()) {
+                typed.AddFraction(d, radixIn);
+            } else {
+                typed.AddInteger(d, radixIn);
+            }
+            number.SetNumber(typed.Value(radixIn));
         }
 
+        // A source seen recently is not parsed again, its number comes
+        // from the parse cache and the typed value is rebuilt on the next
+        // key press.
         std::string ReSetNumber(std::string n) {
-            int radixOut = number.GetRadix();
+            STATS_SCOPE("TCtrl::ReSetNumber");
             n = editor.Set(n, radixIn);
+            TParseKey key = Key(n);
+            if (const long double* parsed = parses.Get(key)) {
+                number.SetNumber(*parsed);
+                typed.synced = false;
+                return n;
+            }
+            int radixOut = number.GetRadix();
             number.SetRadix(radixIn);
             number.SetNumberAsStr(n);
             number.SetRadix(radixOut);
+            Retype(n);
+            parses.Put(std::move(key), number.GetNumber());
             return n;
         }
 
@@ -89,15 +330,78 @@ namespace NCtrl {
             }
             s = s.substr(0, end);
             editor.Set(s, radixIn);
+            typed.synced = false;
             return editor.Get();
         }
 
+        // Output text, from the conversion cache when the source, the
+        // settings and the number are as they were when it was rendered.
         std::string Convert() {
-            return number.ToString();
+            return Render(GetOutput(), renderer);
+        }
+        // Convert() of an output taken by GetOutput(), on any thread with
+        // a renderer of that thread.
+        std::string Render(const TOutput& o, TRenderer& r) const {
+            return conversions.Render(o, r);
+        }
+        TOutput GetOutput() const {
+            std::string source = editor.Get();
+            if (!source.empty() && source.back() == NConst::DOT) {
+                source.pop_back();
+            }
+            return {{std::move(source), radixIn, number.GetRadix(), number.GetPrecision(), number.GetDoCarry()},
+                    number};
+        }
+        // Lookups of ReSetNumber() in the parse cache.
+        uint64_t GetCacheHits() const {
+            return parses.GetHits();
+        }
+        uint64_t GetCacheMisses() const {
+            return parses.GetMisses();
+        }
+        // Lookups of Convert() and Render() in the conversion cache.
+        uint64_t GetConversionHits() const {
+            return conversions.GetHits();
+        }
+        uint64_t GetConversionMisses() const {
+            return conversions.GetMisses();
+        }
+        // The number in every radix from RADIX_MIN to RADIX_MAX, indexed by
+        // radix - RADIX_MIN, with the output precision.
+        std::vector<std::string> ConvertAll() const {
+            return number.ToStringAllRadices();
+        }
+        // Copy of the output number, e.g. to render it on another thread.
+        TPNumber GetOutputNumber() const {
+            return number;
         }
 
+        // Throws history_log_error when the record can not be written to
+        // the log, std::invalid_argument when it does not fit a log record;
+        // it is in the history either way.
         void AddToHistory() {
-            history.AddRecord(radixIn, number.GetRadix(), editor.Get(), number.ToString());
+            std::string source = editor.Get();
+            std::string output = number.ToString();
+            history.AddRecord(radixIn, number.GetRadix(), source, output);
+            // a typed number is the parsed one, SetFromHistory() needs it
+            parses.Put(Key(source), number.GetNumber());
+            if (historyLog) {
+                historyLog->Append({radixIn, number.GetRadix(), source, output});
+            }
+        }
+        // Persists the history to the log at path from now on and loads
+        // the last records in it that fit in the history. Returns the
+        // number of corrupted records skipped; on an error nothing
+        // changes.
+        size_t OpenHistoryLog(const std::string& path) {
+            std::unique_ptr<NHistory::THistoryLog> log(new NHistory::THistoryLog(path));
+            std::vector<NHistory::Record> tail = log->Tail(history.GetCapacity());
+            history.Clear();
+            for (const NHistory::Record& r : tail) {
+                history.AddRecord(r.radix1, r.radix2, r.number1, r.number2);
+            }
+            historyLog = std::move(log);
+            return historyLog->GetCorrupted();
         }
 
         NHistory::Record SetFromHistory(int idx) {
@@ -108,21 +412,148 @@ namespace NCtrl {
             return r;
         }
 
-        std::vector<std::string> GetHistory() {
+        NHistory::THistory::TView GetHistory() const {
             return history.Get();
         }
+        // Indices in GetHistory() of the records that match q.
+        std::vector<size_t> SearchHistory(const NHistory::TQuery& q) const {
+            return history.Search(q);
+        }
+
+        // Source text, number and radix. Snapshots share the pieces of the
+        // source text they have in common; history is not undone.
+        struct TSnapshot {
+            NEditor::TEditor::TSnapshot editor;
+            TPNumber number;
+            int radixIn;
+        };
+        TSnapshot Save() const {
+            return {editor.Save(), number, radixIn};
+        }
+        void Restore(const TSnapshot& s) {
+            editor.Restore(s.editor);
+            number = s.number;
+            radixIn = s.radixIn;
+            typed.synced = false;
+        }
+
+        // Records the current state as an undo step, called after every
+        // user action.
+        void Checkpoint() {
+            journal.Commit(Save());
+        }
+        bool Undo() {
+            const TSnapshot* s = journal.Undo();
+            if (s != NULL) {
+                Restore(*s);
+            }
+            return s != NULL;
+        }
+        bool Redo() {
+            const TSnapshot* s = journal.Redo();
+            if (s != NULL) {
+                Restore(*s);
+            }
+            return s != NULL;
+        }
+        bool CanUndo() const {
+            return journal.GetUndoDepth() > 0;
+        }
+        bool CanRedo() const {
+            return journal.GetRedoDepth() > 0;
+        }
 
     private:
+        // Value of the source text maintained key by key:
+        // ±(integer + fraction / scale), the digits in radixIn. Value() is
+        // what TPNumber::ParseNumber() gives for the same text, which reads
+        // each part with strtoll, saturating at 2^63 - 1, and divides the
+        // fraction by a double power of the radix.
+        struct TTyped {
+            long double integer = 0;
+            long double fraction = 0;
+            long double scale = 1;
+            // fraction digits
+            int digits = 0;
+            bool negative = false;
+            // false after the source changed other than by a key press
+            bool synced = true;
+
+            // A part past 2^64 only ever saturates, it is not updated.
+            void AddInteger(int d, int radix) {
+                if (integer < LIMIT) {
+                    integer = integer * radix + d;
+                }
+            }
+            void AddFraction(int d, int radix) {
+                if (fraction < LIMIT) {
+                    fraction = fraction * radix + d;
+                }
+                if (scale < LIMIT) {
+                    scale *= radix;
+                }
+                digits++;
+            }
+            long double Value(int radix) const {
+                long double v = std::min(integer, MAX);
+                if (fraction <= MAX && scale < 0x1p53L) {
+                    v += fraction / scale; // the power is exact in a double
+                } else if (digits > 0) {
+                    v += std::min(fraction, MAX) / (long double)std::pow((double)radix, (double)digits);
+                }
+                return negative ? -v : v;
+            }
+            // Parts below 2^64 are whole numbers held exactly, so a digit
+            // can be taken back off.
+            bool IsExact() const {
+                return integer < LIMIT && fraction < LIMIT && scale < LIMIT;
+            }
+
+            static constexpr long double LIMIT = 0x1p64L;
+            // LLONG_MAX
+            static constexpr long double MAX = 0x1p63L - 1;
+        };
+
+        TParseKey Key(std::string source) const {
+            if (!source.empty() && source.back() == NConst::DOT) {
+                source.pop_back();
+            }
+            return {std::move(source), radixIn};
+        }
+
+        void Retype(const std::string& s) {
+            typed = TTyped();
+            bool dot = false;
+            for (char c : s) {
+                if (c == NConst::MINUS) {
+                    typed.negative = true;
+                } else if (c == NConst::DOT) {
+                    dot = true;
+                } else if (dot) {
+                    typed.AddFraction(NConst::CharToIdx(c), radixIn);
+                } else {
+                    typed.AddInteger(NConst::CharToIdx(c), radixIn);
+                }
+            }
+        }
+
         int radixIn = 10;
+        TTyped typed;
+        TRenderer renderer;
+        NLru::TLruCache<TParseKey, long double, TParseKeyHash> parses{PARSE_CACHE_CAPACITY};
+        mutable TConversionCache conversions;
 
         TPNumber number;
         NEditor::TEditor editor;
         NHistory::THistory history;
+        std::unique_ptr<NHistory::THistoryLog> historyLog;
+        NJournal::TJournal<TSnapshot> journal;
     };
 }; // namespace NCtrl
 
 #ifdef RUN_TESTS
 #include "acutest.h"
+#include <thread>
 void test_control_operations() {
     using namespace std;
     TEST_CASE("SetOutputPrecision");
@@ -262,7 +693,7 @@ void test_control_operations() {
         string e = "10.E0E";
         TEST_CHECK_(g == e, "%s == %s", g.c_str(), e.c_str());
 
-        TEST_CHECK(c.GetHistory().size() == 2);
+        TEST_CHECK(c.GetHistory().Size() == 2);
         NHistory::Record r1 = c.SetFromHistory(0);
         NHistory::Record r2 = c.SetFromHistory(1);
 
@@ -272,6 +703,564 @@ void test_control_operations() {
         e = "{{15.9375, 10} => {10.E0E, 15}}";
         TEST_CHECK_(r2.ToString() == e, "%s == %s", r2.ToString().c_str(), e.c_str());
     }
+    TEST_CASE("History log");
+    {
+        string path = "/tmp/test_control_history." + to_string(getpid());
+        remove(path.c_str());
+        {
+            NCtrl::TCtrl c;
+            c.OpenHistoryLog(path);
+            c.SetOutputRadix(2);
+            c.ReSetNumber("5");
+            c.AddToHistory();
+            c.ReSetNumber("6");
+            c.AddToHistory();
+        }
+        NCtrl::TCtrl c;
+        c.ReSetNumber("7");
+        c.AddToHistory();
+        c.OpenHistoryLog(path);
+        NHistory::THistory::TView rows = c.GetHistory();
+        TEST_CHECK(rows.Size() == 2 && rows[0] == "{{5, 10} => {101, 2}}" && rows[1] == "{{6, 10} => {110, 2}}");
+        c.ReSetNumber(string(70000, '1'));
+        TEST_EXCEPTION(c.AddToHistory(), std::invalid_argument); // too long for the log
+        TEST_CHECK(c.GetHistory().Size() == 3);
+
+        // the payload of the first record no longer matches its checksum
+        int fd = open(path.c_str(), O_RDWR);
+        TEST_CHECK(pwrite(fd, "9", 1, sizeof(NHistory::HISTORY_LOG_MAGIC) + 12) == 1);
+        close(fd);
+        NCtrl::TCtrl reopened;
+        TEST_CHECK(reopened.OpenHistoryLog(path) == 1);
+        NHistory::THistory::TView loaded = reopened.GetHistory();
+        TEST_CHECK(loaded.Size() == 1 && loaded[0] == "{{6, 10} => {110, 2}}");
+
+        // a file that is not a log changes nothing
+        fd = open(path.c_str(), O_RDWR | O_TRUNC);
+        TEST_CHECK(write(fd, "0123456789", 10) == 10);
+        close(fd);
+        TEST_EXCEPTION(reopened.OpenHistoryLog(path), NHistory::history_log_error);
+        TEST_CHECK(reopened.GetHistory().Size() == 1);
+        NCtrl::TCtrl unlogged;
+        TEST_EXCEPTION(unlogged.OpenHistoryLog(path), NHistory::history_log_error);
+        unlogged.AddToHistory(); // no log attached, nothing written
+        struct stat st;
+        TEST_CHECK(stat(path.c_str(), &st) == 0 && st.st_size == 10);
+        remove(path.c_str());
+    }
+}
+
+void test_control_undo() {
+    using namespace std;
+    TEST_CASE("Undo/Redo");
+    {
+        NCtrl::TCtrl c;
+        TEST_CHECK(!c.CanUndo() && !c.Undo());
+        c.SetSourceRadix(16);
+        c.AddDigit('F');
+        c.Checkpoint();
+        c.AddDot();
+        c.AddDigit('8');
+        c.SetOutputPrecision(1);
+        c.Checkpoint();
+        TEST_CHECK(c.Convert() == "15.5");
+
+        TEST_CHECK(c.Undo());
+        TEST_CHECK(c.GetSourceNumberAsStr() == "F" && c.Convert() == "15");
+        c.AddDot(); // dot state restored too
+        TEST_CHECK(c.GetSourceNumberAsStr() == "F.");
+        TEST_CHECK(c.Redo());
+        TEST_CHECK(c.GetSourceNumberAsStr() == "F.8" && c.Convert() == "15.5");
+        TEST_CHECK(!c.Redo());
+        TEST_CHECK(c.Undo() && c.Undo());
+        TEST_CHECK(c.GetSourceNumberAsStr() == "" && c.GetSourceRadix() == 10);
+        TEST_CHECK(!c.CanUndo() && c.CanRedo());
+        c.AddDigit('1');
+        c.Checkpoint();
+        TEST_CHECK(!c.CanRedo());
+    }
+    TEST_CASE("Snapshots share unchanged text");
+    {
+        NCtrl::TCtrl c;
+        c.AddDigit('7');
+        NCtrl::TCtrl::TSnapshot a = c.Save();
+        c.SetOutputRadix(2);
+        NCtrl::TCtrl::TSnapshot b = c.Save();
+        TEST_CHECK(a.editor.text == b.editor.text);
+        c.AddDigit('1');
+        NCtrl::TCtrl::TSnapshot d = c.Save();
+        TEST_CHECK(d.editor.text != b.editor.text && d.editor.GetText() == "71");
+    }
+    TEST_CASE("TProc and TMemory snapshots");
+    {
+        using NPNumber::TPNumber;
+        NProc::TProc p(10, 2);
+        NJournal::TJournal<NProc::TProc::TSnapshot> j;
+        j.Commit(p.Save());
+        p.SetLeftOp(TPNumber(3, 10, 2));
+        p.SetRightOp(TPNumber(4, 10, 2));
+        p.SetOperation(NProc::TOperation::Mul);
+        j.Commit(p.Save());
+        p.OperationRun();
+        j.Commit(p.Save());
+        TEST_CHECK(p.GetLeftOpRes().GetNumber() == 12);
+        p.Restore(*j.Undo());
+        TEST_CHECK(p.GetLeftOpRes().GetNumber() == 3 && p.GetOperation() == NProc::TOperation::Mul);
+        p.Restore(*j.Undo());
+        TEST_CHECK(p.GetLeftOpRes().GetNumber() == 0 && p.GetOperation() == NProc::TOperation::None);
+
+        NMemory::TMemory m;
+        auto s = m.Save();
+        m.Add(TPNumber(5, 10, 0));
+        m.Restore(s);
+        TEST_CHECK(!m.GetState() && m.Get().GetNumber() == 0);
+    }
+}
+
+#include <random>
+void test_control_typing() {
+    using namespace std;
+    TEST_CASE("Key by key equals re-parse");
+    {
+        mt19937 rng(7);
+        bool same = true;
+        for (int round = 0; round < 200 && same; round++) {
+            int radix = NConst::RADIX_MIN + round % (NConst::RADIX_MAX - 1);
+            NCtrl::TCtrl c;
+            c.SetSourceRadix(radix);
+            c.SetOutputPrecision(8);
+            for (int key = 0; key < 24 && same; key++) {
+                switch (rng() % 8) {
+                    case 0:
+                        c.Backspace();
+                        break;
+                    case 1:
+                        c.AddSign();
+                        break;
+                    case 2:
+                        try {
+                            c.AddDot();
+                        } catch (const NEditor::invalid_digit&) {
+                        }
+                        break;
+                    default:
+                        c.AddDigit(NConst::ALPHABET[rng() % radix]);
+                }
+                NCtrl::TCtrl fresh;
+                fresh.SetSourceRadix(radix);
+                fresh.SetOutputPrecision(8);
+                fresh.ReSetNumber(c.GetSourceNumberAsStr());
+                same = c.Convert() == fresh.Convert();
+                if (!same) {
+                    TEST_MSG("radix %d '%s': %s != %s", radix, c.GetSourceNumberAsStr().c_str(),
+                             c.Convert().c_str(), fresh.Convert().c_str());
+                }
+            }
+        }
+        TEST_CHECK(same);
+    }
+    TEST_CASE("Long inputs saturate as parsed");
+    {
+        for (int radix : {16, 10, 2, 3}) {
+            for (const string& digits : {string(16, 'F'), string(18, '7'), string(20, '9'), string(40, '1')}) {
+                for (const string& text : {digits, "-" + digits, "1." + digits, digits + "." + digits}) {
+                    NCtrl::TCtrl typed, parsed;
+                    typed.SetSourceRadix(radix);
+                    parsed.SetSourceRadix(radix);
+                    try {
+                        for (char ch : text) {
+                            if (ch == '-') {
+                                typed.AddSign();
+                            } else if (ch == '.') {
+                                typed.AddDot();
+                            } else {
+                                typed.AddDigit(ch);
+                            }
+                        }
+                    } catch (const NEditor::invalid_digit&) {
+                        continue; // not a digit of this radix
+                    }
+                    parsed.ReSetNumber(text);
+                    TEST_CHECK_(typed.GetOutputNumber().GetNumber() == parsed.GetOutputNumber().GetNumber(),
+                                "radix %d '%s'", radix, text.c_str());
+                    TEST_CHECK(typed.Convert() == parsed.Convert());
+                    typed.Backspace();
+                    parsed.ReSetNumber(text.substr(0, text.size() - 1));
+                    TEST_CHECK_(typed.GetOutputNumber().GetNumber() == parsed.GetOutputNumber().GetNumber(),
+                                "radix %d '%s' backspace", radix, text.c_str());
+                }
+            }
+        }
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        c.SetOutputRadix(16);
+        for (int i = 0; i < 16; i++) {
+            c.AddDigit('F');
+        }
+        TEST_CHECK(c.Convert() == "7FFFFFFFFFFFFFFF");
+    }
+    TEST_CASE("Radix change re-parses");
+    {
+        NCtrl::TCtrl c;
+        c.AddDigit('1');
+        c.AddDigit('0');
+        c.SetSourceRadix(2);
+        c.AddDigit('1');
+        TEST_CHECK(c.GetSourceNumberAsStr() == "101" && c.Convert() == "5");
+        c.SetSourceRadix(16);
+        c.AddDigit('F');
+        TEST_CHECK(c.Convert() == "4127"); // 0x101F
+        c.SetSourceRadix(2);
+        TEST_EXCEPTION(c.AddDigit('1'), NEditor::invalid_digit);
+    }
+}
+
+void test_control_render() {
+    using namespace std;
+    TEST_CASE("Incremental Convert equals full render");
+    {
+        mt19937 rng(11);
+        const int radices[] = {2, 4, 8, 16, 10, 3};
+        bool same = true;
+        for (int round = 0; round < 300 && same; round++) {
+            int in = radices[rng() % 6];
+            int out = radices[rng() % 6];
+            int precision = rng() % 3;
+            NCtrl::TCtrl c;
+            c.SetSourceRadix(in);
+            c.SetOutputRadix(out);
+            c.SetOutputPrecision(precision);
+            for (int key = 0; key < 30 && same; key++) {
+                switch (rng() % 10) {
+                    case 0:
+                    case 1:
+                        c.Backspace();
+                        break;
+                    case 2:
+                        c.AddSign();
+                        break;
+                    case 3:
+                        if (rng() % 4 == 0) {
+                            c.Clear();
+                        }
+                        break;
+                    default:
+                        if (c.GetSourceNumberAsStr().size() < 14) {
+                            c.AddDigit(NConst::ALPHABET[rng() % in]);
+                        }
+                }
+                NPNumber::TPNumber expect(0, in, precision);
+                expect.SetNumberAsStr(c.GetSourceNumberAsStr());
+                expect.SetRadix(out);
+                string got = c.Convert();
+                same = got == expect.ToString();
+                if (!same) {
+                    TEST_MSG("%d -> %d '%s': %s != %s", in, out, c.GetSourceNumberAsStr().c_str(),
+                             got.c_str(), expect.ToString().c_str());
+                }
+            }
+        }
+        TEST_CHECK(same);
+    }
+    TEST_CASE("Suffix of all 64 bits");
+    {
+        for (int radix : {16, 4, 2}) {
+            NCtrl::TRenderer r;
+            r.Render(NPNumber::TPNumber(0, radix, 0));
+            NPNumber::TPNumber max(0x1p63L - 1, radix, 0);
+            TEST_CHECK(r.Render(max) == max.ToString());
+            r.Render(NPNumber::TPNumber(1, radix, 0));
+            TEST_CHECK(r.Render(max) == max.ToString());
+        }
+    }
+    TEST_CASE("Falls back on radix, precision and fraction changes");
+    {
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        c.SetOutputRadix(2);
+        c.AddDigit('A');
+        TEST_CHECK(c.Convert() == "1010");
+        c.AddDigit('1');
+        TEST_CHECK(c.Convert() == "10100001");
+        c.SetOutputRadix(8);
+        TEST_CHECK(c.Convert() == "241");
+        c.SetOutputPrecision(2);
+        TEST_CHECK(c.Convert() == "241.00");
+        c.AddDot();
+        c.AddDigit('8');
+        TEST_CHECK(c.Convert() == "241.40");
+        c.Backspace();
+        c.Backspace();
+        c.Backspace();
+        TEST_CHECK(c.Convert() == "12.00");
+    }
+    TEST_CASE("ConvertAll");
+    {
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        c.SetOutputPrecision(1);
+        c.ReSetNumber("-1F.8");
+        vector<string> all = c.ConvertAll();
+        TEST_CHECK(all.size() == NConst::RADIX_MAX - NConst::RADIX_MIN + 1);
+        TEST_CHECK(all[2 - NConst::RADIX_MIN] == "-11111.1");
+        TEST_CHECK(all[10 - NConst::RADIX_MIN] == "-31.5");
+        TEST_CHECK(all[16 - NConst::RADIX_MIN] == "-1F.8");
+    }
+}
+
+void test_control_cache() {
+    using namespace std;
+    TEST_CASE("Repeated sources hit");
+    {
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        c.SetOutputPrecision(2);
+        c.ReSetNumber("1F.8");
+        TEST_CHECK(c.Convert() == "31.50");
+        TEST_CHECK(c.GetCacheHits() == 0 && c.GetCacheMisses() == 1);
+        c.ReSetNumber("0");
+        c.SetOutputRadix(2); // output settings are not part of the key
+        c.SetOutputPrecision(1);
+        c.ReSetNumber("1F.8");
+        TEST_CHECK(c.GetCacheHits() == 1 && c.Convert() == "11111.1");
+        c.SetSourceRadix(10);
+        TEST_EXCEPTION(c.ReSetNumber("1F.8"), NEditor::invalid_digit);
+        c.ReSetNumber("1"); // another radix, another key
+        c.SetSourceRadix(16);
+        c.ReSetNumber("1");
+        TEST_CHECK(c.GetCacheHits() == 1 && c.GetCacheMisses() == 4);
+    }
+    TEST_CASE("History records are cached");
+    {
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        for (char d : string("1FFFFFFFFFFFFFFFF.8")) {
+            d == '.' ? c.AddDot() : c.AddDigit(d);
+        }
+        c.AddToHistory();
+        c.Clear();
+        uint64_t hits = c.GetCacheHits();
+        c.SetFromHistory(0);
+        NCtrl::TCtrl parsed;
+        parsed.SetSourceRadix(16);
+        parsed.ReSetNumber("1FFFFFFFFFFFFFFFF.8");
+        TEST_CHECK(c.GetCacheHits() == hits + 1 && c.Convert() == parsed.Convert());
+    }
+    TEST_CASE("Typed after a hit");
+    {
+        NCtrl::TCtrl c;
+        c.ReSetNumber("12.");
+        c.ReSetNumber("12"); // same key, the trailing dot dropped
+        TEST_CHECK(c.GetCacheHits() == 1 && c.Convert() == "12");
+        c.AddDigit('5');
+        c.AddSign();
+        TEST_CHECK(c.GetSourceNumberAsStr() == "-125" && c.Convert() == "-125");
+        c.Backspace();
+        TEST_CHECK(c.Convert() == "-12");
+    }
+    TEST_CASE("Conversions are cached");
+    {
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        c.SetOutputPrecision(1);
+        c.ReSetNumber("1F.8");
+        TEST_CHECK(c.Convert() == "31.5" && c.GetConversionMisses() == 1);
+        TEST_CHECK(c.Convert() == "31.5" && c.GetConversionHits() == 1);
+        c.SetOutputRadix(2);
+        TEST_CHECK(c.Convert() == "11111.1" && c.GetConversionMisses() == 2);
+        c.SetOutputRadix(10);
+        c.ReSetNumber("1F.");
+        c.ReSetNumber("1F.8"); // the number comes from the parse cache
+        TEST_CHECK(c.Convert() == "31.5" && c.GetConversionHits() == 2);
+        c.SetOutputPrecision(3);
+        TEST_CHECK(c.Convert() == "31.500" && c.GetConversionMisses() == 3);
+        c.Backspace(); // the number changed, the source is "1F."
+        TEST_CHECK(c.Convert() == "31.000" && c.GetConversionMisses() == 4);
+    }
+    TEST_CASE("Rendered on another thread");
+    {
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        c.ReSetNumber("FF");
+        NCtrl::TOutput output = c.GetOutput();
+        string text;
+        thread worker([&] {
+            NCtrl::TRenderer renderer;
+            text = c.Render(output, renderer);
+        });
+        c.SetOutputRadix(2);
+        string binary = c.Convert();
+        worker.join();
+        TEST_CHECK(text == "255" && binary == "11111111");
+        c.SetOutputRadix(10);
+        TEST_CHECK(c.Convert() == "255" && c.GetConversionHits() == 1);
+    }
 }
 #endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+
+// A checkpoint after every key press: numbers of up to 12 digits are
+// typed and cleared, 10^6 steps in total.
+void bench_control_undo() {
+    const size_t steps = 1000000;
+    NCtrl::TCtrl c;
+    c.SetSourceRadix(16);
+    size_t before = NBench::HeapInUse();
+    size_t i = 0;
+    NBench::Measure("TCtrl key press + Checkpoint", steps, [&] {
+        if (i % 13 == 12) {
+            c.Clear();
+        } else {
+            c.AddDigit(NConst::ALPHABET[i % 16]);
+        }
+        c.Checkpoint();
+        i++;
+    });
+    printf("  %-48s %12.2f bytes/step\n", "journal growth", double(NBench::HeapInUse() - before) / steps);
+    NBench::Measure("TCtrl Undo", steps, [&] {
+        c.Undo();
+    });
+    NBench::Measure("TCtrl Redo", steps, [&] {
+        c.Redo();
+    });
+    // One long number: a snapshot must not copy the text typed so far.
+    for (size_t digits : {10000, 100000}) {
+        char title[96];
+        NCtrl::TCtrl d;
+        d.SetSourceRadix(16);
+        before = NBench::HeapInUse();
+        i = 0;
+        snprintf(title, sizeof(title), "TCtrl key press + Checkpoint, %zu digits", digits);
+        NBench::Measure(title, digits, [&] {
+            d.AddDigit(NConst::ALPHABET[i++ % 16]);
+            d.Checkpoint();
+        });
+        printf("  %-48s %12.2f bytes/step\n", "journal growth", double(NBench::HeapInUse() - before) / digits);
+        snprintf(title, sizeof(title), "TCtrl Undo, %zu digits", digits);
+        NBench::Measure(title, digits, [&] {
+            d.Undo();
+        });
+    }
+}
+
+// Typing one long number key by key, incrementally and with a full
+// re-parse of the source after every key as before.
+void bench_control_typing() {
+    for (size_t digits : {1000, 10000, 100000}) {
+        char title[96];
+        NCtrl::TCtrl c;
+        c.SetSourceRadix(16);
+        size_t i = 0;
+        snprintf(title, sizeof(title), "TCtrl::AddDigit, %zu digits", digits);
+        NBench::Measure(title, digits, [&] {
+            if (i == digits / 2) {
+                c.AddDot();
+            }
+            c.AddDigit(NConst::ALPHABET[i++ % 16]);
+        });
+        if (digits > 10000) {
+            continue; // quadratic
+        }
+        c.Clear();
+        i = 0;
+        snprintf(title, sizeof(title), "TCtrl::ReSetNumber per key, %zu digits", digits);
+        std::string typed;
+        NBench::Measure(title, digits, [&] {
+            if (i == digits / 2) {
+                typed += NConst::DOT;
+            }
+            typed += NConst::ALPHABET[i++ % 16];
+            c.ReSetNumber(typed);
+        });
+    }
+}
+
+// Convert() after every key press while typing 15 digit hex numbers,
+// against the key press alone and a full TPNumber::ToString.
+void bench_control_render() {
+    for (int out : {2, 16, 10}) {
+        char title[96];
+        for (bool convert : {false, true}) {
+            NCtrl::TCtrl c;
+            c.SetSourceRadix(16);
+            c.SetOutputRadix(out);
+            c.SetOutputPrecision(2);
+            size_t i = 0;
+            snprintf(title, sizeof(title), "AddDigit%s, 16 -> %d", convert ? " + Convert" : "", out);
+            NBench::Measure(title, 100000, [&] {
+                if (i % 15 == 0) {
+                    c.Clear();
+                }
+                c.AddDigit(NConst::ALPHABET[i++ % 16]);
+                if (convert) {
+                    NBench::DoNotOptimize(c.Convert());
+                }
+            });
+        }
+        NPNumber::TPNumber n(0x123456789ABCDEFLL, out, 2);
+        snprintf(title, sizeof(title), "TPNumber::ToString, radix %d", out);
+        NBench::Measure(title, 100000, [&] {
+            NBench::DoNotOptimize(n.ToString());
+        });
+    }
+}
+
+// The value in all 15 radices at once against 15 ToString() calls.
+void bench_control_all_radices() {
+    for (long double v : {0x123456789ABCDEFLL * 1.0L, -2 / 7.0L, 123456.789L}) {
+        char title[96];
+        NPNumber::TPNumber n(v, 10, 4);
+        std::string value = n.ToString();
+        snprintf(title, sizeof(title), "15 x ToString, %s", value.c_str());
+        NBench::Measure(title, 20000, [&] {
+            for (int r = NConst::RADIX_MIN; r <= NConst::RADIX_MAX; r++) {
+                n.SetRadix(r);
+                NBench::DoNotOptimize(n.ToString());
+            }
+        });
+        snprintf(title, sizeof(title), "ToStringAllRadices, %s", value.c_str());
+        NBench::Measure(title, 20000, [&] {
+            NBench::DoNotOptimize(n.ToStringAllRadices());
+        });
+    }
+}
+
+// A source set again, e.g. picked from the history or pasted: 64
+// fractional hex numbers, all hits once the cache is warm, against as
+// many numbers never seen before.
+void bench_control_cache() {
+    const size_t steps = 192000;
+    std::vector<std::string> sources;
+    for (size_t i = 0; i < 64 + steps; i++) {
+        NPNumber::TPNumber n(i * 1234.5678L, 16, 6);
+        sources.push_back(n.ToString());
+    }
+    NCtrl::TCtrl c;
+    c.SetSourceRadix(16);
+    size_t i = 0;
+    NBench::Measure("TCtrl::ReSetNumber, cache hit", steps, [&] {
+        c.ReSetNumber(sources[i++ % 64]);
+    });
+    i = 0;
+    NBench::Measure("TCtrl::ReSetNumber, cache miss", steps, [&] {
+        c.ReSetNumber(sources[64 + i++]);
+    });
+    printf("  %-48s %llu hits, %llu misses\n", "parse cache", (unsigned long long)c.GetCacheHits(),
+           (unsigned long long)c.GetCacheMisses());
+    i = 0;
+    NBench::Measure("TCtrl::ReSetNumber + Convert, cache hit", steps, [&] {
+        c.ReSetNumber(sources[i++ % 64]);
+        NBench::DoNotOptimize(c.Convert());
+    });
+    i = 0;
+    NBench::Measure("TCtrl::ReSetNumber + Convert, cache miss", steps, [&] {
+        c.ReSetNumber(sources[64 + i++]);
+        NBench::DoNotOptimize(c.Convert());
+    });
+    printf("  %-48s %llu hits, %llu misses\n", "conversion cache", (unsigned long long)c.GetConversionHits(),
+           (unsigned long long)c.GetConversionMisses());
+}
+#endif // #ifdef RUN_BENCH
 #endif //#ifndef TCTRL_CC
@@ -1,9 +1,12 @@
 #ifndef TEDITOR_CC
 #define TEDITOR_CC
+#include <algorithm>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 #include "const.cc"
+#include "journal.cc"
 
 namespace NEditor {
 
@@ -20,73 +23,183 @@ namespace NEditor {
         }
     };
 
+    // Text with a movable cursor: the free space (gap) sits at the cursor,
+    // so insert and delete there are O(1) amortised and moving the cursor
+    // costs the distance moved.
+    class TGapBuffer {
+    public:
+        size_t Size() const {
+            return buf.size() - (gapEnd - gapBegin);
+        }
+        size_t GetCursor() const {
+            return gapBegin;
+        }
+        void MoveCursor(size_t pos) {
+            if (pos > Size()) {
+                throw std::out_of_range("Cursor " + to_string(pos) + " past " + to_string(Size()));
+            }
+            if (pos < gapBegin) {
+                std::move_backward(buf.begin() + pos, buf.begin() + gapBegin, buf.begin() + gapEnd);
+                gapEnd -= gapBegin - pos;
+                gapBegin = pos;
+            } else {
+                size_t n = pos - gapBegin;
+                std::move(buf.begin() + gapEnd, buf.begin() + gapEnd + n, buf.begin() + gapBegin);
+                gapBegin += n;
+                gapEnd += n;
+            }
+        }
+        char At(size_t i) const {
+            return i < gapBegin ? buf[i] : buf[i + gapEnd - gapBegin];
+        }
+
+        void Insert(char c) {
+            Reserve(1);
+            buf[gapBegin++] = c;
+        }
+        // Removes the symbol before / after the cursor, which must exist.
+        char EraseBack() {
+            return buf[--gapBegin];
+        }
+        char EraseForward() {
+            return buf[gapEnd++];
+        }
+        void Clear() {
+            gapBegin = 0;
+            gapEnd = buf.size();
+        }
+
+        string ToString() const {
+            string s;
+            s.reserve(Size());
+            s.append(buf.data(), gapBegin);
+            s.append(buf.data() + gapEnd, buf.size() - gapEnd);
+            return s;
+        }
+
+    private:
+        void Reserve(size_t n) {
+            if (gapEnd - gapBegin >= n) {
+                return;
+            }
+            size_t tail = buf.size() - gapEnd;
+            std::vector<char> grown(std::max({buf.size() * 2, buf.size() + n, size_t(16)}));
+            std::copy_n(buf.data(), gapBegin, grown.data());
+            // an empty tail copied to grown.end() trips -Warray-bounds
+            if (tail != 0) {
+                std::copy_n(buf.data() + gapEnd, tail, grown.data() + grown.size() - tail);
+            }
+            gapEnd = grown.size() - tail;
+            buf.swap(grown);
+        }
+
+        std::vector<char> buf;
+        size_t gapBegin = 0;
+        size_t gapEnd = 0;
+    };
+
+    // Source number editor. The digits and the dot live in a gap buffer
+    // edited at the cursor, the sign is a flag and the dot position is
+    // kept up to date, so no edit rebuilds the text.
+    // The Add*() / Backspace() calls edit at the cursor and return the
+    // whole text as before; Insert*() / Erase*() are their O(1) forms.
     class TEditor {
     public:
         TEditor(){};
 
         bool IsZero() const {
-            return str == "0" || str == "-0";
+            return digits.Size() == 1 && digits.At(0) == ZERO;
         }
 
         bool IsEmpty() const {
-            return str.empty() || str == "-";
+            return digits.Size() == 0;
         }
 
+        void ToggleSign() {
+            negative = !negative;
+        }
         string AddSign() {
-            if (!str.empty() && str[0] == MINUS) {
-                str = str.substr(1);
-            } else {
-                str = MINUS + str;
-            }
-            return str;
+            ToggleSign();
+            return Get();
         }
 
-        string AddDigit(char symbol, int base = 16) {
+        // A zero alone is replaced by the digit, i.e. -0 -> -A
+        void InsertDigit(char symbol, int base = 16) {
             if (!NConst::IsValidChar(symbol, base)) {
                 throw invalid_digit("Invalid p number " + to_string(symbol));
             }
-            if (IsZero()) {
-                str[str.size() - 1] = symbol; // overwrite leading zero i.e. -0 -> -A
-            } else {
-                str += symbol;
+            if (IsZero() && digits.GetCursor() == 1) {
+                Erased(0, digits.EraseBack());
             }
-            return str;
+            Insert(symbol);
+        }
+        string AddDigit(char symbol, int base = 16) {
+            InsertDigit(symbol, base);
+            return Get();
         }
 
-        bool HasDot() {
-            return dotSeen;
+        bool HasDot() const {
+            return dot != string::npos;
+        }
+        // Index of the dot in the text without the sign, npos if none.
+        size_t GetDotPos() const {
+            return dot;
         }
 
-        string AddDot() {
-            if (dotSeen) {
-                throw invalid_digit("Dot alredy present in: '" + str + "'");
+        void InsertDot() {
+            if (HasDot()) {
+                throw invalid_digit("Dot alredy present in: '" + Get() + "'");
             }
-            dotSeen = true;
-            str += DOT;
-            return str;
+            dot = digits.GetCursor();
+            Insert(DOT);
+        }
+        string AddDot() {
+            InsertDot();
+            return Get();
         }
 
         string AddZero() {
-            str += ZERO;
-            return str;
+            Insert(ZERO);
+            return Get();
         }
 
-        string Backspace() {
-            size_t size = str.size();
-            if (size > 0) {
-                if (str[size - 1] == DOT) {
-                    dotSeen = false;
-                }
-                str.resize(size - 1);
+        // Deletes the symbol before the cursor, at the start of the text
+        // that is the sign.
+        void EraseBack() {
+            if (digits.GetCursor() > 0) {
+                Erased(digits.GetCursor() - 1, digits.EraseBack());
+            } else {
+                negative = false;
             }
-            return str;
+        }
+        void EraseForward() {
+            if (digits.GetCursor() < digits.Size()) {
+                Erased(digits.GetCursor(), digits.EraseForward());
+            }
+        }
+        string Backspace() {
+            EraseBack();
+            return Get();
+        }
+
+        // Position in the text without the sign.
+        size_t GetCursor() const {
+            return digits.GetCursor();
+        }
+        void MoveCursor(size_t pos) {
+            digits.MoveCursor(pos);
+        }
+        size_t Size() const {
+            return digits.Size();
         }
 
         string Clear() {
-            str.clear();
-            str += ZERO;
-            dotSeen = false;
-            return str;
+            digits.Clear();
+            edited = 0;
+            digits.Insert(ZERO);
+            negative = false;
+            dot = string::npos;
+            return Get();
         }
 
         string Set(std::string in, int base) {
@@ -95,30 +208,151 @@ namespace NEditor {
             size_t i = 0;
             if (inSize > 0 && in[i] == MINUS) {
                 i++;
-                new_.AddSign();
+                new_.ToggleSign();
             }
             for (; i < in.size(); i++) {
                 char c = in[i];
                 switch (c) {
                     case DOT:
-                        new_.AddDot();
+                        new_.InsertDot();
                         break;
                     default:
-                        new_.AddDigit(c, base);
+                        new_.InsertDigit(c, base);
                 }
             }
-            dotSeen = new_.dotSeen;
-            str = new_.Get();
-            return str;
+            *this = std::move(new_);
+            return Get();
         }
 
         string Get() const {
-            return str;
+            return negative ? MINUS + digits.ToString() : digits.ToString();
+        }
+        // Symbol before the cursor, the sign at the start, '\0' when none.
+        char Back() const {
+            if (digits.GetCursor() > 0) {
+                return digits.At(digits.GetCursor() - 1);
+            }
+            return negative ? MINUS : '\0';
+        }
+
+        // Piece of snapshot text: the text is the chain of pieces through
+        // prev, all of them PIECE symbols long but the last one.
+        struct TPiece {
+            NJournal::TShared<TPiece> prev;
+            size_t begin; // position of chars[0] in the text
+            string chars;
+            size_t End() const {
+                return begin + chars.size();
+            }
+        };
+        static const size_t PIECE = 64;
+
+        struct TSnapshot {
+            NJournal::TShared<TPiece> text; // without the sign, NULL if empty
+            bool negative;
+            size_t dot;
+            size_t cursor;
+
+            string GetText() const {
+                string s;
+                for (const TPiece* p = text.get(); p != NULL; p = p->prev.get()) {
+                    s.insert(0, p->chars);
+                }
+                return negative ? MINUS + s : s;
+            }
+        };
+        // Shares the pieces of the last snapshot saved or restored up to
+        // the first symbol edited since, so typing at the end costs O(1)
+        // per snapshot.
+        TSnapshot Save() const {
+            if (edited != string::npos) {
+                base = Rebuild(base, std::min(edited, digits.Size()));
+                edited = string::npos;
+            }
+            return {base, negative, dot, digits.GetCursor()};
+        }
+        // Edits the text from the last piece it shares with s, so undoing
+        // a key press costs O(1) as well.
+        void Restore(const TSnapshot& s) {
+            const TPiece* a = base.get();
+            const TPiece* b = s.text.get();
+            while (a != b) {
+                if (a != NULL && (b == NULL || a->begin >= b->begin)) {
+                    a = a->prev.get();
+                } else {
+                    b = b->prev.get();
+                }
+            }
+            size_t keep = std::min({edited, digits.Size(), a != NULL ? a->End() : 0});
+            digits.MoveCursor(digits.Size());
+            while (digits.Size() > keep) {
+                digits.EraseBack();
+            }
+            std::vector<const TPiece*> added;
+            for (const TPiece* p = s.text.get(); p != NULL && p->End() > keep; p = p->prev.get()) {
+                added.push_back(p);
+            }
+            for (auto p = added.rbegin(); p != added.rend(); ++p) {
+                for (size_t i = std::max(keep, (*p)->begin) - (*p)->begin; i < (*p)->chars.size(); i++) {
+                    digits.Insert((*p)->chars[i]);
+                }
+            }
+            digits.MoveCursor(s.cursor);
+            negative = s.negative;
+            dot = s.dot;
+            base = s.text;
+            edited = string::npos;
         }
 
     private:
-        bool dotSeen = false;
-        string str = "";
+        // Pieces of from below keep, then the text from keep on.
+        NJournal::TShared<TPiece> Rebuild(NJournal::TShared<TPiece> from, size_t keep) const {
+            while (from && from->begin >= keep) {
+                from = from->prev;
+            }
+            size_t begin = keep;
+            string chars;
+            if (from && (from->End() > keep || from->chars.size() < PIECE)) {
+                begin = from->begin;
+                chars = from->chars.substr(0, keep - begin);
+                from = from->prev;
+            }
+            for (size_t i = keep; i < digits.Size(); i++) {
+                chars.push_back(digits.At(i));
+                if (chars.size() == PIECE) {
+                    from = std::make_shared<const TPiece>(TPiece{from, begin, std::move(chars)});
+                    begin += PIECE;
+                    chars.clear();
+                }
+            }
+            if (!chars.empty()) {
+                from = std::make_shared<const TPiece>(TPiece{from, begin, std::move(chars)});
+            }
+            return from;
+        }
+
+        void Insert(char c) {
+            edited = std::min(edited, digits.GetCursor());
+            if (HasDot() && dot >= digits.GetCursor() && c != DOT) {
+                dot++;
+            }
+            digits.Insert(c);
+        }
+        void Erased(size_t pos, char c) {
+            edited = std::min(edited, pos);
+            if (c == DOT) {
+                dot = string::npos;
+            } else if (HasDot() && dot > pos) {
+                dot--;
+            }
+        }
+
+        TGapBuffer digits;
+        bool negative = false;
+        size_t dot = string::npos;
+        // Text of the last snapshot and the first position edited since.
+        mutable NJournal::TShared<TPiece> base;
+        mutable size_t edited = string::npos;
     };
 }; // namespace NEditor
 
@@ -214,6 +448,127 @@ void test_editor_operations() {
     }
 }
 
-// tests
+void test_editor_cursor() {
+    using NEditor::TEditor;
+    using NEditor::TGapBuffer;
+    TEST_CASE("TGapBuffer");
+    {
+        TGapBuffer b;
+        for (char c : std::string("0123456789ABCDEF0123")) {
+            b.Insert(c);
+        }
+        b.MoveCursor(4);
+        b.Insert('x');
+        TEST_CHECK(b.ToString() == "0123x456789ABCDEF0123" && b.GetCursor() == 5);
+        TEST_CHECK(b.EraseForward() == '4' && b.EraseBack() == 'x');
+        b.MoveCursor(b.Size());
+        b.Insert('y');
+        TEST_CHECK(b.ToString() == "012356789ABCDEF0123y" && b.At(4) == '5');
+        TEST_EXCEPTION(b.MoveCursor(b.Size() + 1), std::out_of_range);
+    }
+    TEST_CASE("Mid-string edits");
+    {
+        TEditor e;
+        e.Set("-12.34", 10);
+        TEST_CHECK(e.GetDotPos() == 2 && e.GetCursor() == 5);
+        e.MoveCursor(1);
+        e.InsertDigit('9', 10);
+        TEST_CHECK(e.Get() == "-192.34" && e.GetDotPos() == 3);
+        e.EraseForward();
+        TEST_CHECK(e.Get() == "-19.34" && e.GetDotPos() == 2);
+        e.MoveCursor(3);
+        e.EraseBack(); // the dot
+        TEST_CHECK(e.Get() == "-1934" && !e.HasDot());
+        e.MoveCursor(1);
+        e.InsertDot();
+        TEST_CHECK(e.Get() == "-1.934" && e.GetDotPos() == 1);
+        TEST_EXCEPTION(e.InsertDot(), NEditor::invalid_digit);
+        e.ToggleSign();
+        TEST_CHECK(e.Get() == "1.934");
+        e.MoveCursor(0);
+        e.ToggleSign();
+        e.EraseBack(); // at the start removes the sign
+        TEST_CHECK(e.Get() == "1.934" && e.Back() == '\0');
+    }
+    TEST_CASE("Snapshot keeps cursor");
+    {
+        TEditor e;
+        e.Set("-A.B", 16);
+        e.MoveCursor(1);
+        TEditor::TSnapshot s = e.Save();
+        e.Clear();
+        e.Restore(s);
+        TEST_CHECK(e.Get() == "-A.B" && e.GetCursor() == 1 && e.GetDotPos() == 1);
+    }
+    TEST_CASE("Snapshots share pieces");
+    {
+        TEditor e;
+        std::vector<TEditor::TSnapshot> s;
+        std::vector<std::string> texts;
+        for (int i = 0; i < 300; i++) {
+            e.InsertDigit(NConst::ALPHABET[1 + i % 15]);
+            if (i == 100) {
+                e.InsertDot();
+            }
+            s.push_back(e.Save());
+            texts.push_back(e.Get());
+        }
+        TEST_CHECK(s[299].text->prev->prev == s[200].text->prev);
+        TEST_CHECK(s[299].GetText() == texts[299] && e.Save().text == s[299].text);
+        e.MoveCursor(5);
+        e.EraseBack();
+        e.ToggleSign();
+        TEditor::TSnapshot mid = e.Save();
+        TEST_CHECK(mid.GetText() == "-" + texts[299].substr(0, 4) + texts[299].substr(5));
+        bool same = true;
+        for (size_t i : {150, 299, 7, 0, 298, 64, 63, 65}) {
+            e.Restore(s[i]);
+            same = same && e.Get() == texts[i] && e.GetCursor() == i + 1 + (i >= 100);
+            same = same && e.GetDotPos() == (i >= 100 ? 101 : std::string::npos);
+        }
+        e.Restore(mid);
+        TEST_CHECK(same && e.Get() == mid.GetText() && e.GetCursor() == 4 && e.GetDotPos() == 100);
+    }
+    TEST_CASE("Large input");
+    {
+        std::string big(1 << 20, '7');
+        big[big.size() / 2] = '.';
+        TEditor e;
+        e.Set(big, 8);
+        e.MoveCursor(10);
+        for (int i = 0; i < 1000; i++) {
+            e.InsertDigit('1', 8);
+        }
+        TEST_CHECK(e.Size() == big.size() + 1000 && e.GetDotPos() == big.size() / 2 + 1000);
+    }
+}
 #endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+
+// Typing into the middle of a 10^6 digit source, gap buffer against
+// inserting into a std::string.
+void bench_editor_insert() {
+    const size_t size = 1000000;
+    const size_t iters = 10000;
+    std::string text(size, '5');
+    NEditor::TEditor e;
+    e.Set(text, 10);
+    e.MoveCursor(size / 2);
+    NBench::Measure("TEditor::InsertDigit mid 10^6", iters, [&] {
+        e.InsertDigit('1', 10);
+    });
+    NBench::Measure("TEditor::EraseBack mid 10^6", iters, [&] {
+        e.EraseBack();
+    });
+    size_t pos = size / 2;
+    NBench::Measure("std::string::insert mid 10^6", iters, [&] {
+        text.insert(text.begin() + pos++, '1');
+    });
+    NBench::Measure("TEditor::Set 10^6", 10, [&] {
+        e.Set(text, 10);
+    });
+}
+#endif // #ifdef RUN_BENCH
 #endif //#ifndef TEDITOR_CC
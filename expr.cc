@@ -0,0 +1,575 @@
+#ifndef EXPR_CC
+#define EXPR_CC
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "const.cc"
+#include "lru.cc"
+#include "pnumber.cc"
+#include "proc.cc"
+
+// Formulas such as "(a+b)*c/d" compiled once into register bytecode and
+// evaluated with TProc semantics.
+//
+// Grammar (spaces are ignored):
+//   expr    := term (('+' | '-') term)*
+//   term    := unary (('*' | '/') unary)*
+//   unary   := '-' unary | primary
+//   primary := number | name | 'sqr(' expr ')' | 'rev(' expr ')' | '(' expr ')'
+// A number starts with a decimal digit or a dot and is read in the radix of
+// the program, so hex literals need a leading zero ("0FF"); a name starts
+// with a letter or '_' and is a variable.
+namespace NExpr {
+    using NPNumber::TPNumber;
+    using NProc::TFunction;
+    using NProc::TOperation;
+    using NProc::TProc;
+
+    // Nesting of '(', function calls and unary '-' the compiler recurses into.
+    static const size_t EXPR_DEPTH_MAX = 256;
+
+    class invalid_expression : public std::invalid_argument {
+    public:
+        explicit invalid_expression(const std::string& message)
+            : std::invalid_argument(message) {
+        }
+    };
+
+    enum struct TOpCode : uint8_t { Const, // r[dst] = constants[a]
+                                    Var,   // r[dst] = vars[a]
+                                    Add,   // r[dst] = r[a] op r[b], dst == a
+                                    Sub,
+                                    Mul,
+                                    Div,
+                                    Neg,   // r[dst] = 0 - r[a]
+                                    Sqr,   // r[dst] = f(r[a]), dst == a
+                                    Revert };
+
+    // Where the right operand b of a binary instruction lives, loads of a
+    // variable or a constant are folded into the instruction that uses them.
+    enum struct TOperand : uint8_t { Reg,
+                                     Var,
+                                     Const };
+
+    struct TInstruction {
+        TOpCode code;
+        uint8_t dst;
+        uint16_t a;
+        uint16_t b;
+        TOperand bKind;
+    };
+
+    class TProgram {
+    public:
+        static TProgram Compile(const std::string& formula, int radix = 10, int precision = 0) {
+            TProgram p(radix, precision);
+            TCompiler c(p, formula);
+            c.Run();
+            return p;
+        }
+
+        // Variable names in order of first appearance, the order of Run() arguments.
+        const std::vector<std::string>& GetVariables() const {
+            return variables;
+        }
+        size_t GetRegisters() const {
+            return registers;
+        }
+        const std::vector<TInstruction>& GetCode() const {
+            return code;
+        }
+        const std::vector<TPNumber>& GetConstants() const {
+            return constants;
+        }
+        int GetRadix() const {
+            return radix;
+        }
+        int GetPrecision() const {
+            return precision;
+        }
+        // Zero of the program radix and precision.
+        const TPNumber& GetZero() const {
+            return zero;
+        }
+
+    private:
+        TProgram(int r, int p)
+            : radix(TPNumber::ValidateRadix(r))
+            , precision(TPNumber::ValidatePrecision(p))
+            , zero(0, radix, precision) {
+        }
+
+        class TCompiler {
+        public:
+            TCompiler(TProgram& p, const std::string& f)
+                : program(p)
+                , formula(f) {
+            }
+
+            void Run() {
+                Expr(0);
+                Skip();
+                if (pos != formula.size()) {
+                    Fail("unexpected '" + std::string(1, formula[pos]) + "'");
+                }
+            }
+
+        private:
+            void Expr(uint8_t r) {
+                Term(r);
+                while (Skip(), pos < formula.size() && (formula[pos] == '+' || formula[pos] == '-')) {
+                    TOpCode code = formula[pos++] == '+' ? TOpCode::Add : TOpCode::Sub;
+                    Term(Next(r));
+                    EmitBinary(code, r);
+                }
+            }
+
+            void Term(uint8_t r) {
+                Unary(r);
+                while (Skip(), pos < formula.size() && (formula[pos] == '*' || formula[pos] == '/')) {
+                    TOpCode code = formula[pos++] == '*' ? TOpCode::Mul : TOpCode::Div;
+                    Unary(Next(r));
+                    EmitBinary(code, r);
+                }
+            }
+
+            void Unary(uint8_t r) {
+                Skip();
+                if (pos < formula.size() && formula[pos] == NConst::MINUS) {
+                    pos++;
+                    Enter();
+                    Unary(r);
+                    depth--;
+                    Emit(TOpCode::Neg, r, r, 0);
+                    return;
+                }
+                Primary(r);
+            }
+
+            void Primary(uint8_t r) {
+                Skip();
+                if (pos >= formula.size()) {
+                    Fail("unexpected end");
+                }
+                char c = formula[pos];
+                if (c == '(') {
+                    pos++;
+                    Enter();
+                    Expr(r);
+                    depth--;
+                    Expect(')');
+                } else if (IsDigit(c) || c == NConst::DOT) {
+                    size_t start = pos;
+                    while (pos < formula.size() && (IsAlnum(formula[pos]) || formula[pos] == NConst::DOT)) {
+                        pos++;
+                    }
+                    std::string literal = formula.substr(start, pos - start);
+                    try {
+                        program.constants.emplace_back(TPNumber::ParseNumber(literal, program.radix),
+                                                       program.radix, program.precision);
+                    } catch (const NPNumber::invalid_pnumber&) {
+                        Fail("invalid number '" + literal + "' in radix " + std::to_string(program.radix));
+                    }
+                    Emit(TOpCode::Const, r, Index(program.constants.size() - 1), 0);
+                } else if (IsAlpha(c) || c == '_') {
+                    size_t start = pos;
+                    while (pos < formula.size() && (IsAlnum(formula[pos]) || formula[pos] == '_')) {
+                        pos++;
+                    }
+                    std::string name = formula.substr(start, pos - start);
+                    Skip();
+                    if (pos < formula.size() && formula[pos] == '(') {
+                        TOpCode code = TOpCode::Sqr;
+                        if (name == "rev") {
+                            code = TOpCode::Revert;
+                        } else if (name != "sqr") {
+                            Fail("unknown function '" + name + "'");
+                        }
+                        pos++;
+                        Enter();
+                        Expr(r);
+                        depth--;
+                        Expect(')');
+                        Emit(code, r, r, 0);
+                        return;
+                    }
+                    auto& vars = program.variables;
+                    size_t idx = std::find(vars.begin(), vars.end(), name) - vars.begin();
+                    if (idx == vars.size()) {
+                        vars.push_back(name);
+                    }
+                    Emit(TOpCode::Var, r, Index(idx), 0);
+                } else {
+                    Fail("unexpected '" + std::string(1, c) + "'");
+                }
+            }
+
+            void Enter() {
+                if (++depth > EXPR_DEPTH_MAX) {
+                    Fail("expression is nested too deep");
+                }
+            }
+
+            uint8_t Next(uint8_t r) {
+                if (r + 1 > UINT8_MAX) {
+                    Fail("expression is nested too deep");
+                }
+                return r + 1;
+            }
+
+            uint16_t Index(size_t i) {
+                if (i > UINT16_MAX) {
+                    Fail("too many constants or variables");
+                }
+                return i;
+            }
+
+            void Emit(TOpCode code, uint8_t dst, uint16_t a, uint16_t b, TOperand bKind = TOperand::Reg) {
+                program.code.push_back({code, dst, a, b, bKind});
+                program.registers = std::max<size_t>(program.registers, dst + 1u);
+            }
+
+            // r = r op r+1, reading a plain variable or constant in place
+            void EmitBinary(TOpCode code, uint8_t r) {
+                TInstruction& last = program.code.back();
+                if (last.dst == r + 1 && (last.code == TOpCode::Var || last.code == TOpCode::Const)) {
+                    TOperand kind = last.code == TOpCode::Var ? TOperand::Var : TOperand::Const;
+                    uint16_t idx = last.a;
+                    program.code.pop_back();
+                    Emit(code, r, r, idx, kind);
+                } else {
+                    Emit(code, r, r, r + 1);
+                }
+            }
+
+            void Skip() {
+                while (pos < formula.size() && isspace((unsigned char)formula[pos])) {
+                    pos++;
+                }
+            }
+
+            void Expect(char c) {
+                Skip();
+                if (pos >= formula.size() || formula[pos] != c) {
+                    Fail("expected '" + std::string(1, c) + "'");
+                }
+                pos++;
+            }
+
+            // <cctype> is undefined for negative char other than EOF
+            static bool IsDigit(char c) {
+                return isdigit((unsigned char)c);
+            }
+            static bool IsAlpha(char c) {
+                return isalpha((unsigned char)c);
+            }
+            static bool IsAlnum(char c) {
+                return isalnum((unsigned char)c);
+            }
+
+            [[noreturn]] void Fail(const std::string& what) {
+                throw invalid_expression(what + " at " + std::to_string(pos) + " in '" + formula + "'");
+            }
+
+            TProgram& program;
+            const std::string& formula;
+            size_t pos = 0;
+            size_t depth = 0;
+        };
+
+        int radix;
+        int precision;
+        TPNumber zero;
+        size_t registers = 0;
+        std::vector<TInstruction> code;
+        std::vector<TPNumber> constants;
+        std::vector<std::string> variables;
+    };
+
+    // Interpreter with its own register file, reusable across Run() calls.
+    class TMachine {
+    public:
+        // Evaluate program with vars in GetVariables() order. On the first
+        // failing step evaluation stops, GetError() explains it and zero
+        // of the program radix and precision is returned.
+        TPNumber Run(const TProgram& program, const std::vector<TPNumber>& vars) {
+            STATS_SCOPE("TMachine::Run");
+            error.clear();
+            const TPNumber& zero = program.GetZero();
+            if (vars.size() != program.GetVariables().size()) {
+                error = "Expected " + std::to_string(program.GetVariables().size()) +
+                        " variables, got " + std::to_string(vars.size());
+                return zero;
+            }
+            if (regs.size() < program.GetRegisters()) {
+                regs.resize(program.GetRegisters(), zero);
+            }
+            const auto& constants = program.GetConstants();
+            for (const TInstruction& i : program.GetCode()) {
+                NNumber::TStatus status = NNumber::TStatus::Ok;
+                const TPNumber& b = i.bKind == TOperand::Reg   ? regs[i.b]
+                                    : i.bKind == TOperand::Var ? vars[i.b]
+                                                               : constants[i.b];
+                switch (i.code) {
+                    case TOpCode::Const:
+                        regs[i.dst] = constants[i.a];
+                        break;
+                    case TOpCode::Var:
+                        regs[i.dst] = vars[i.a];
+                        break;
+                    case TOpCode::Add:
+                        status = TProc::TryApply(TOperation::Add, regs[i.a], b, failure);
+                        break;
+                    case TOpCode::Sub:
+                        status = TProc::TryApply(TOperation::Sub, regs[i.a], b, failure);
+                        break;
+                    case TOpCode::Mul:
+                        status = TProc::TryApply(TOperation::Mul, regs[i.a], b, failure);
+                        break;
+                    case TOpCode::Div:
+                        status = TProc::TryApply(TOperation::Div, regs[i.a], b, failure);
+                        break;
+                    case TOpCode::Neg:
+                        regs[i.dst] = zero - regs[i.a];
+                        break;
+                    case TOpCode::Sqr:
+                        status = TProc::TryApply(TFunction::Sqr, regs[i.a], failure);
+                        break;
+                    case TOpCode::Revert:
+                        status = TProc::TryApply(TFunction::Revert, regs[i.a], failure);
+                        break;
+                }
+                if (status != NNumber::TStatus::Ok) {
+                    error = failure.ToString();
+                    return zero;
+                }
+            }
+            return regs.empty() ? zero : regs[0];
+        }
+
+        std::string GetError() const {
+            return error;
+        }
+
+    private:
+        std::vector<TPNumber> regs;
+        NNumber::TError failure;
+        std::string error;
+    };
+
+    static const size_t PROGRAM_CACHE_CAPACITY = 4096;
+
+    // What a compiled program depends on, TProgramKey owns the formula
+    // and TProgramQuery only looks it up.
+    template <typename TFormula>
+    struct TProgramKeyOf {
+        TFormula formula;
+        int radix;
+        int precision;
+
+        template <typename T>
+        bool operator==(const TProgramKeyOf<T>& o) const {
+            return radix == o.radix && precision == o.precision && formula == o.formula;
+        }
+    };
+    using TProgramKey = TProgramKeyOf<std::string>;
+    using TProgramQuery = TProgramKeyOf<std::string_view>;
+
+    struct TProgramKeyHash {
+        template <typename TFormula>
+        size_t operator()(const TProgramKeyOf<TFormula>& k) const {
+            size_t settings = (size_t)k.radix << 16 | (size_t)(k.precision & 0xFFFF);
+            return std::hash<std::string_view>()(k.formula) ^ settings * 0x9E3779B97F4A7C15ULL;
+        }
+    };
+
+    // The most recently used compiled programs, keyed by formula text and
+    // the radix and precision the literals were read in. A returned
+    // program stays valid until a later Get() misses.
+    class TProgramCache {
+    public:
+        explicit TProgramCache(size_t capacity = PROGRAM_CACHE_CAPACITY)
+            : programs(capacity) {
+        }
+
+        const TProgram& Get(const std::string& formula, int radix = 10, int precision = 0) {
+            if (const TProgram* p = programs.Get(TProgramQuery{formula, radix, precision})) {
+                return *p;
+            }
+            return programs.Put({formula, radix, precision}, TProgram::Compile(formula, radix, precision));
+        }
+
+        size_t Size() const {
+            return programs.Size();
+        }
+        size_t GetCapacity() const {
+            return programs.GetCapacity();
+        }
+        size_t GetHits() const {
+            return programs.GetHits() - hits;
+        }
+        size_t GetMisses() const {
+            return programs.GetMisses() - misses;
+        }
+        void Clear() {
+            programs.Clear();
+            hits = programs.GetHits();
+            misses = programs.GetMisses();
+        }
+
+    private:
+        NLru::TLruCache<TProgramKey, TProgram, TProgramKeyHash> programs;
+        // counts of programs before the last Clear()
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+} // namespace NExpr
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+void test_expr() {
+    using namespace NExpr;
+    TEST_CASE("Compile");
+    {
+        TProgram p = TProgram::Compile("(a+b)*c/d");
+        TEST_CHECK((p.GetVariables() == std::vector<std::string>{"a", "b", "c", "d"}));
+        TEST_CHECK(p.GetRegisters() == 2);
+        TEST_CHECK(p.GetCode().size() == 4); // loads of b, c, d are folded
+        TEST_CHECK(TProgram::Compile("x * x + x").GetVariables().size() == 1);
+        TEST_EXCEPTION(TProgram::Compile("(a+b"), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("a+"), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("a b"), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("cos(a)"), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("1F", 10), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("1", 17), NPNumber::invalid_radix);
+        TEST_EXCEPTION(TProgram::Compile("a\xE9"), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("\xC3\xA9 + 1"), invalid_expression);
+    }
+    TEST_CASE("Nesting");
+    {
+        std::string deep = std::string(EXPR_DEPTH_MAX, '(') + "a" + std::string(EXPR_DEPTH_MAX, ')');
+        TEST_CHECK(TProgram::Compile(deep).GetRegisters() == 1);
+        TEST_EXCEPTION(TProgram::Compile("(" + deep + ")"), invalid_expression);
+        TEST_CHECK(TProgram::Compile(std::string(EXPR_DEPTH_MAX, '-') + "a").GetCode().size() == EXPR_DEPTH_MAX + 1);
+        TEST_EXCEPTION(TProgram::Compile(std::string(1000000, '-') + "a"), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile(std::string(1000000, '(')), invalid_expression);
+        TEST_EXCEPTION(TProgram::Compile("sqr(" + deep + ")"), invalid_expression);
+    }
+    TEST_CASE("Run");
+    {
+        TMachine m;
+        TProgram p = TProgram::Compile("(a+b)*c/d", 16, 2);
+        TPNumber r = m.Run(p, {TPNumber(1, 16, 2), TPNumber(2, 16, 2), TPNumber(10, 16, 2), TPNumber(4, 16, 2)});
+        TEST_CHECK(m.GetError() == "");
+        TEST_CHECK_(r.ToString() == "7.80", "%s", r.ToString().c_str());
+
+        p = TProgram::Compile("-0A + sqr(x) - rev(.8) * 2", 16, 1);
+        r = m.Run(p, {TPNumber(3, 16, 1)});
+        TEST_CHECK_(r.GetNumber() == -10 + 9 - 4, "%s", r.Repr().c_str());
+
+        p = TProgram::Compile("1 - 2 - 3");
+        TEST_CHECK(m.Run(p, {}).GetNumber() == -4);
+        p = TProgram::Compile("2 * (3 + 4) - 12 / 3 / 2");
+        TEST_CHECK(m.Run(p, {}).GetNumber() == 12);
+        p = TProgram::Compile("101.1", 2, 1);
+        TEST_CHECK(m.Run(p, {}).GetNumber() == 5.5);
+    }
+    TEST_CASE("Run errors");
+    {
+        TMachine m;
+        TProgram p = TProgram::Compile("a / (b - 1)");
+        TPNumber r = m.Run(p, {TPNumber(1), TPNumber(1)});
+        TEST_CHECK(m.GetError() == "Division by zero");
+        TEST_CHECK(r.GetNumber() == 0);
+        r = m.Run(p, {TPNumber(6), TPNumber(4)});
+        TEST_CHECK(m.GetError() == "" && r.GetNumber() == 2);
+        m.Run(TProgram::Compile("rev(a - a)"), {TPNumber(3)});
+        TEST_CHECK(m.GetError() == "Division by zero");
+        m.Run(p, {TPNumber(1)});
+        TEST_CHECK(m.GetError().find("Expected 2 variables") == 0);
+    }
+    TEST_CASE("Cache");
+    {
+        TProgramCache cache;
+        const TProgram& p1 = cache.Get("a+b");
+        const TProgram& p2 = cache.Get("a+b");
+        TEST_CHECK(&p1 == &p2);
+        cache.Get("a+b", 16);
+        TEST_CHECK(cache.Size() == 2 && cache.GetHits() == 1 && cache.GetMisses() == 2);
+        cache.Clear();
+        TEST_CHECK(cache.Size() == 0 && cache.GetHits() == 0);
+    }
+    TEST_CASE("Cache capacity");
+    {
+        TProgramCache cache(2);
+        cache.Get("a+b");
+        cache.Get("a-b");
+        cache.Get("a+b");
+        cache.Get("a*b"); // evicts a-b, a+b was used after it
+        TEST_CHECK(cache.Size() == 2 && cache.GetMisses() == 3);
+        cache.Get("a+b");
+        cache.Get("a-b");
+        TEST_CHECK(cache.GetHits() == 2 && cache.GetMisses() == 4);
+        for (int i = 0; i < 1000; i++) {
+            cache.Get("a+" + std::to_string(i));
+        }
+        TEST_CHECK(cache.Size() == 2 && cache.GetCapacity() == 2);
+        TEST_EXCEPTION(TProgramCache(0), std::invalid_argument);
+    }
+}
+#endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+
+void bench_expr() {
+    using namespace NExpr;
+    const size_t iters = 1000000;
+    std::vector<TPNumber> vars = {TPNumber(1.5, 16, 4), TPNumber(2.25, 16, 4),
+                                  TPNumber(7, 16, 4), TPNumber(3, 16, 4)};
+    NBench::Measure("TProgram::Compile (a+b)*c/d", iters / 10, [&] {
+        NBench::DoNotOptimize(TProgram::Compile("(a+b)*c/d", 16, 4).GetRegisters());
+    });
+    TProgram program = TProgram::Compile("(a+b)*c/d", 16, 4);
+    TMachine m;
+    NBench::Measure("TMachine::Run (a+b)*c/d", iters, [&] {
+        NBench::DoNotOptimize(m.Run(program, vars));
+    });
+    TProgramCache cache;
+    const std::string formula = "(a+b)*c/d";
+    NBench::Measure("TProgramCache::Get + TMachine::Run", iters, [&] {
+        NBench::DoNotOptimize(m.Run(cache.Get(formula, 16, 4), vars));
+    });
+    std::vector<std::string> formulas;
+    for (size_t i = 0; i < iters / 10; i++) {
+        formulas.push_back("(a+b)*c/" + std::to_string(i));
+    }
+    size_t i = 0;
+    NBench::Measure("TProgramCache::Get, distinct formulas", formulas.size(), [&] {
+        NBench::DoNotOptimize(cache.Get(formulas[i++], 16, 4).GetRegisters());
+    });
+    printf("  %-48s %zu of %zu programs kept\n", "TProgramCache", cache.Size(), cache.GetMisses());
+    TProc proc(16, 4);
+    NBench::Measure("TProc driven step by step", iters, [&] {
+        proc.SetLeftOp(vars[0]);
+        proc.SetRightOp(vars[1]);
+        proc.SetOperation(TOperation::Add);
+        proc.OperationRun();
+        proc.SetRightOp(vars[2]);
+        proc.SetOperation(TOperation::Mul);
+        proc.OperationRun();
+        proc.SetRightOp(vars[3]);
+        proc.SetOperation(TOperation::Div);
+        proc.OperationRun();
+        NBench::DoNotOptimize(proc.GetLeftOpRes());
+    });
+}
+#endif // #ifdef RUN_BENCH
+#endif // #ifndef EXPR_CC
@@ -0,0 +1,413 @@
+#ifndef FFT_CC
+#define FFT_CC
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "complex.cc"
+#include "const.cc"
+
+namespace NFFT {
+    using NComplex::TBasicComplex;
+    using NComplex::TBasicComplexArray;
+
+    // Rounded convolution values must be this close to an integer.
+    static const double FFT_MAX_ROUNDING_ERROR = 0.25;
+    // Below this length schoolbook multiplication is faster than the FFT.
+    static const size_t FFT_SCHOOLBOOK_MAX = 64;
+    // Widest limb, products of two limbs still fit in 64-bit accumulators.
+    static const int FFT_MAX_LIMB_BITS = 24;
+
+    // Iterative in-place FFT of a fixed power of two size.
+    // Twiddles are stored per stage: roots[len / 2 + j] = exp(-2*pi*i*j/len),
+    // so every butterfly stage walks its table contiguously.
+    template <typename T = double>
+    class TFFT {
+    public:
+        using TComplex = TBasicComplex<T>;
+        using TComplexArray = TBasicComplexArray<T>;
+
+        explicit TFFT(size_t n)
+            : size(n)
+            , roots(std::max<size_t>(n, 2), TComplex(1.0, 0.0))
+            , reversed(n, 0) {
+            if (n == 0 || (n & (n - 1)) != 0) {
+                throw std::invalid_argument("FFT size is not a power of two: " + std::to_string(n));
+            }
+            while ((size_t(1) << log2n) < n) {
+                log2n++;
+            }
+            for (size_t i = 1; i < n; i++) {
+                reversed[i] = (reversed[i >> 1] >> 1) | ((i & 1) << (log2n - 1));
+            }
+            // every root is computed directly, not by recurrence, to keep the error at 1 ulp
+            for (size_t len = 2; len <= n; len <<= 1) {
+                for (size_t j = 0; j < len / 2; j++) {
+                    long double angle = -2.0L * M_PIl * j / len;
+                    roots[len / 2 + j] = TComplex(std::cos(angle), std::sin(angle));
+                }
+            }
+        }
+
+        size_t Size() const {
+            return size;
+        }
+
+        void Forward(TComplexArray& a) const {
+            Transform(a);
+        }
+
+        // Inverse transform including the 1/n scaling.
+        void Inverse(TComplexArray& a) const {
+            for (auto& c : a) {
+                c.Imagn = -c.Imagn;
+            }
+            Transform(a);
+            const T scale = T(1) / size;
+            for (auto& c : a) {
+                c.Real *= scale;
+                c.Imagn = -c.Imagn * scale;
+            }
+        }
+
+    private:
+        void Transform(TComplexArray& a) const {
+            if (a.size() != size) {
+                throw std::invalid_argument("FFT size mismatch: " + std::to_string(a.size()) +
+                                            " != " + std::to_string(size));
+            }
+            for (size_t i = 0; i < size; i++) {
+                if (i < reversed[i]) {
+                    std::swap(a[i], a[reversed[i]]);
+                }
+            }
+            size_t len = 1;
+            if (log2n & 1) {
+                // odd number of stages, one radix-2 pass first
+                for (size_t i = 0; i < size; i += 2) {
+                    TComplex u = a[i];
+                    a[i] = u + a[i + 1];
+                    a[i + 1] = u - a[i + 1];
+                }
+                len = 2;
+            }
+            // radix-4 passes, each one fuses two radix-2 stages (len -> 4 * len)
+            for (; len < size; len <<= 2) {
+                const TComplex* w2 = &roots[len];     // exp(-2*pi*i*j/(2*len))
+                const TComplex* w4 = &roots[2 * len]; // exp(-2*pi*i*j/(4*len))
+                for (size_t i = 0; i < size; i += 4 * len) {
+                    for (size_t j = 0; j < len; j++) {
+                        TComplex* p = &a[i + j];
+                        TComplex t1 = w2[j] * p[len];
+                        TComplex t3 = w2[j] * p[3 * len];
+                        TComplex x0 = p[0] + t1;
+                        TComplex x1 = p[0] - t1;
+                        TComplex x2 = w4[j] * (p[2 * len] + t3);
+                        // w4[j + len] = w4[j] * -i
+                        TComplex x3 = w4[j] * (p[2 * len] - t3);
+                        x3 = TComplex(x3.Imagn, -x3.Real);
+                        p[0] = x0 + x2;
+                        p[2 * len] = x0 - x2;
+                        p[len] = x1 + x3;
+                        p[3 * len] = x1 - x3;
+                    }
+                }
+            }
+        }
+
+        size_t size;
+        size_t log2n = 0;
+        std::vector<TComplex> roots;
+        std::vector<size_t> reversed;
+    };
+
+    // Digits of a p-ary number, least significant first.
+    using TDigits = std::vector<int>;
+
+    static void ValidateBase(int base) {
+        if (base < NConst::RADIX_MIN || base > NConst::RADIX_MAX) {
+            throw std::invalid_argument("Invalid base: " + std::to_string(base));
+        }
+    }
+
+    TDigits DigitsFromString(const std::string& s, int base) {
+        ValidateBase(base);
+        TDigits d;
+        d.reserve(s.size());
+        for (auto it = s.rbegin(); it != s.rend(); it++) {
+            if (!NConst::IsValidChar(*it, base)) {
+                throw std::invalid_argument("Invalid digit '" + std::string(1, *it) +
+                                            "' for base " + std::to_string(base));
+            }
+            d.push_back(NConst::CharToIdx(*it));
+        }
+        return d;
+    }
+
+    std::string DigitsToString(const TDigits& d) {
+        size_t top = d.size();
+        while (top > 1 && d[top - 1] == 0) {
+            top--;
+        }
+        if (top == 0) {
+            return "0";
+        }
+        std::string s(top, NConst::ZERO);
+        for (size_t i = 0; i < top; i++) {
+            s[top - 1 - i] = NConst::ALPHABET[d[i]];
+        }
+        return s;
+    }
+
+    // Strip leading (most significant) zeros, zero is represented as {}.
+    static TDigits Trim(TDigits d) {
+        while (!d.empty() && d.back() == 0) {
+            d.pop_back();
+        }
+        return d;
+    }
+
+    TDigits MultiplySchoolbook(const TDigits& a, const TDigits& b, int base) {
+        ValidateBase(base);
+        if (a.empty() || b.empty()) {
+            return {};
+        }
+        std::vector<unsigned long long> acc(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); i++) {
+            for (size_t j = 0; j < b.size(); j++) {
+                acc[i + j] += (unsigned long long)a[i] * b[j];
+            }
+        }
+        TDigits r(acc.size());
+        unsigned long long carry = 0;
+        for (size_t i = 0; i < acc.size(); i++) {
+            carry += acc[i];
+            r[i] = carry % base;
+            carry /= base;
+        }
+        return Trim(r);
+    }
+
+    // Worst case rounding error of a double FFT convolution of n limbs below
+    // `limb`, a conservative form of the usual c * limb^2 * n * log2(n) * eps bound.
+    static double ConvolutionErrorBound(double limb, size_t n) {
+        double log2n = std::max(1.0, std::log2((double)n));
+        return 4.0 * limb * limb * n * log2n * std::numeric_limits<double>::epsilon();
+    }
+
+    // FFT convolution of a and b grouped into limbs of `digitsPerLimb` digits.
+    // Returns false if the rounding error came too close to 0.5.
+    static bool MultiplyLimbs(const TDigits& a, const TDigits& b, int base, size_t digitsPerLimb, TDigits& out) {
+        long long limbBase = 1;
+        for (size_t i = 0; i < digitsPerLimb; i++) {
+            limbBase *= base;
+        }
+        auto toLimbs = [&](const TDigits& d) {
+            std::vector<long long> limbs((d.size() + digitsPerLimb - 1) / digitsPerLimb, 0);
+            for (size_t i = d.size(); i-- > 0;) {
+                limbs[i / digitsPerLimb] = limbs[i / digitsPerLimb] * base + d[i];
+            }
+            return limbs;
+        };
+        std::vector<long long> la = toLimbs(a), lb = toLimbs(b);
+        size_t n = 1;
+        while (n < la.size() + lb.size()) {
+            n <<= 1;
+        }
+        // pack a into the real and b into the imaginary part: one forward FFT
+        TBasicComplexArray<double> f(n, TBasicComplex<double>(0.0, 0.0));
+        for (size_t i = 0; i < la.size(); i++) {
+            f[i].Real = la[i];
+        }
+        for (size_t i = 0; i < lb.size(); i++) {
+            f[i].Imagn = lb[i];
+        }
+        TFFT<double> fft(n);
+        fft.Forward(f);
+        // A[k] * B[k] = (F[k]^2 - conj(F[n-k])^2) / 4i
+        TBasicComplexArray<double> g(n, TBasicComplex<double>(0.0, 0.0));
+        for (size_t k = 0; k < n; k++) {
+            const auto& x = f[k];
+            TBasicComplex<double> y(f[(n - k) & (n - 1)].Real, -f[(n - k) & (n - 1)].Imagn);
+            TBasicComplex<double> d = x.Sqr() - y.Sqr();
+            g[k] = TBasicComplex<double>(d.Imagn / 4, -d.Real / 4);
+        }
+        fft.Inverse(g);
+
+        out.assign((la.size() + lb.size()) * digitsPerLimb + 1, 0);
+        double maxError = 0;
+        unsigned long long carry = 0;
+        size_t pos = 0;
+        for (size_t i = 0; i < la.size() + lb.size(); i++) {
+            double v = std::round(g[i].Real);
+            maxError = std::max(maxError, std::abs(g[i].Real - v));
+            carry += (unsigned long long)v;
+            unsigned long long limb = carry % limbBase;
+            carry /= limbBase;
+            for (size_t j = 0; j < digitsPerLimb; j++) {
+                out[pos++] = limb % base;
+                limb /= base;
+            }
+        }
+        while (carry) {
+            out[pos++] = carry % base;
+            carry /= base;
+        }
+        out = Trim(out);
+        return maxError < FFT_MAX_ROUNDING_ERROR;
+    }
+
+    // Multiply two p-ary numbers with an FFT convolution.
+    // Digits are grouped into the widest limbs whose error bound still
+    // allows exact rounding; if the measured rounding error is nevertheless
+    // too large the limbs are narrowed, down to schoolbook as a last resort.
+    TDigits Multiply(const TDigits& a, const TDigits& b, int base) {
+        ValidateBase(base);
+        TDigits ta = Trim(a), tb = Trim(b);
+        if (ta.empty() || tb.empty()) {
+            return {};
+        }
+        if (std::min(ta.size(), tb.size()) <= FFT_SCHOOLBOOK_MAX) {
+            return MultiplySchoolbook(ta, tb, base);
+        }
+        size_t digitsPerLimb = 1;
+        double limb = base;
+        // limbs of up to 2^FFT_MAX_LIMB_BITS keep the products exact in long long
+        auto fftSize = [&](size_t k) {
+            size_t limbs = (ta.size() + k - 1) / k + (tb.size() + k - 1) / k;
+            size_t n = 1;
+            while (n < limbs) {
+                n <<= 1;
+            }
+            return n;
+        };
+        while (limb * base <= (double)(1 << FFT_MAX_LIMB_BITS)) {
+            if (ConvolutionErrorBound(limb * base - 1, fftSize(digitsPerLimb + 1)) >= FFT_MAX_ROUNDING_ERROR) {
+                break;
+            }
+            limb *= base;
+            digitsPerLimb++;
+        }
+        TDigits r;
+        for (; digitsPerLimb > 0; digitsPerLimb--) {
+            if (MultiplyLimbs(ta, tb, base, digitsPerLimb, r)) {
+                return r;
+            }
+        }
+        return MultiplySchoolbook(ta, tb, base);
+    }
+} // namespace NFFT
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+#include <complex>
+#include <random>
+
+void test_fft() {
+    using namespace NFFT;
+    using NComplex::TComplex;
+    using NComplex::TComplexArray;
+    TEST_CASE("Size");
+    {
+        TEST_EXCEPTION(TFFT<>(0), std::invalid_argument);
+        TEST_EXCEPTION(TFFT<>(12), std::invalid_argument);
+        TFFT<> f(8);
+        TComplexArray a(4, TComplex(0.0, 0.0));
+        TEST_EXCEPTION(f.Forward(a), std::invalid_argument);
+    }
+    TEST_CASE("Forward against naive DFT");
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> dist(-1.0, 1.0);
+        for (size_t n : {1, 2, 4, 8, 32, 128, 512}) {
+            TComplexArray a;
+            for (size_t i = 0; i < n; i++) {
+                a.push_back(TComplex(dist(rng), dist(rng)));
+            }
+            TComplexArray f = a;
+            TFFT<>(n).Forward(f);
+            double maxErr = 0;
+            for (size_t k = 0; k < n; k++) {
+                std::complex<long double> sum = 0;
+                for (size_t j = 0; j < n; j++) {
+                    long double angle = -2.0L * M_PIl * ((j * k) % n) / n;
+                    sum += std::complex<long double>(a[j].Real, a[j].Imagn) *
+                           std::complex<long double>(std::cos(angle), std::sin(angle));
+                }
+                maxErr = std::max(maxErr, (double)std::abs(sum - std::complex<long double>(f[k].Real, f[k].Imagn)));
+            }
+            TEST_CHECK_(maxErr < 1e-12, "n=%zu error %g", n, maxErr);
+
+            TFFT<>(n).Inverse(f);
+            maxErr = 0;
+            for (size_t i = 0; i < n; i++) {
+                maxErr = std::max(maxErr, (f[i] - a[i]).Abs());
+            }
+            TEST_CHECK_(maxErr < 1e-14, "n=%zu round trip error %g", n, maxErr);
+        }
+    }
+    TEST_CASE("Digits");
+    {
+        TEST_CHECK(DigitsToString(DigitsFromString("00FE01", 16)) == "FE01");
+        TEST_CHECK(DigitsToString({}) == "0");
+        TEST_CHECK((DigitsFromString("102", 3) == TDigits{2, 0, 1}));
+        TEST_EXCEPTION(DigitsFromString("12", 2), std::invalid_argument);
+    }
+    TEST_CASE("Multiply");
+    {
+        TEST_CHECK(DigitsToString(Multiply(DigitsFromString("FF", 16), DigitsFromString("FF", 16), 16)) == "FE01");
+        TEST_CHECK(DigitsToString(Multiply(DigitsFromString("0", 10), DigitsFromString("123", 10), 10)) == "0");
+        TEST_EXCEPTION(Multiply({1}, {1}, 17), std::invalid_argument);
+        std::mt19937 rng(11);
+        for (int base : {2, 3, 10, 16}) {
+            for (size_t len : {100, 1000, 5000}) {
+                std::uniform_int_distribution<int> digit(0, base - 1);
+                TDigits a(len), b(len / 2 + 3);
+                for (auto& d : a) {
+                    d = digit(rng);
+                }
+                for (auto& d : b) {
+                    d = digit(rng);
+                }
+                TDigits all(len, base - 1); // worst case for the error bound
+                TEST_CHECK_(Multiply(a, b, base) == MultiplySchoolbook(a, b, base),
+                            "base %d, %zu digits", base, len);
+                TEST_CHECK_(Multiply(all, all, base) == MultiplySchoolbook(all, all, base),
+                            "base %d, %zu max digits", base, len);
+            }
+        }
+    }
+}
+#endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include <random>
+
+void bench_fft_multiply() {
+    using namespace NFFT;
+    std::mt19937 rng(3);
+    for (int base : {2, 10, 16}) {
+        std::uniform_int_distribution<int> digit(0, base - 1);
+        for (size_t len = 1000; len <= 10000000; len *= 10) {
+            TDigits a(len), b(len);
+            for (size_t i = 0; i < len; i++) {
+                a[i] = digit(rng);
+                b[i] = digit(rng);
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "Multiply base %d, 10^%d digits", base, (int)std::log10(len));
+            NBench::Measure(name, 1, [&] { NBench::DoNotOptimize(Multiply(a, b, base).size()); });
+            if (len <= 100000) {
+                snprintf(name, sizeof(name), "MultiplySchoolbook base %d, 10^%d digits", base, (int)std::log10(len));
+                NBench::Measure(name, 1, [&] { NBench::DoNotOptimize(MultiplySchoolbook(a, b, base).size()); });
+            }
+        }
+    }
+}
+#endif // #ifdef RUN_BENCH
+#endif // #ifndef FFT_CC
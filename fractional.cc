@@ -71,6 +71,9 @@ namespace NFrac {
             denominator = tmp.GetDenominator();
         }
 
+        bool IsZero() const {
+            return numerator == 0;
+        }
         bool operator==(const TFrac& rhs) const {
             return GetNumerator() == rhs.GetNumerator() and
                    GetDenominator() == rhs.GetDenominator();
@@ -1,72 +1,670 @@
 #ifndef HISTORY_CC
 #define HISTORY_CC
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
 #include <string>
-#include <list>
+#include <string_view>
 #include <vector>
 #include <stdexcept>
 
 namespace NHistory {
+    static const size_t HISTORY_CAPACITY = 1024;
 
     struct Record {
-        const int radix1;
-        const int radix2;
-        const std::string number1;
-        const std::string number2;
+        int radix1;
+        int radix2;
+        std::string number1;
+        std::string number2;
 
         std::string ToString() const {
-            return "{{" + number1 + ", " + std::to_string(radix1) + "} =>" +
-                   " {" + number2 + ", " + std::to_string(radix2) + "}}";
+            return Format(radix1, radix2, number1, number2);
         }
-        bool operator==(Record& rhs) const {
+        bool operator==(const Record& rhs) const {
             return radix1 == rhs.radix1 && radix2 == rhs.radix2 &&
                    number1 == rhs.number1 && number2 == rhs.number2;
         }
+
+        static std::string Format(int radix1, int radix2, std::string_view number1, std::string_view number2) {
+            std::string s;
+            s.reserve(number1.size() + number2.size() + 20);
+            s.append("{{").append(number1).append(", ").append(std::to_string(radix1));
+            s.append("} => {").append(number2).append(", ").append(std::to_string(radix2)).append("}}");
+            return s;
+        }
     };
 
-    class THistory {
+    // Interned strings in one buffer, each stored once behind a one byte
+    // length (0xFF and a u32 for longer ones) and named by its 32-bit
+    // offset. The buffer only grows, an owner drops garbage by interning
+    // what it still uses into a new arena.
+    class TStringArena {
     public:
-        THistory() {
+        uint32_t Intern(std::string_view s) {
+            if ((count + 1) * 4 > table.size() * 3) {
+                Rehash(table.empty() ? 64 : table.size() * 2);
+            }
+            size_t mask = table.size() - 1;
+            size_t i = Hash(s) & mask;
+            for (; table[i] != EMPTY; i = (i + 1) & mask) {
+                if (Get(table[i]) == s) {
+                    return table[i];
+                }
+            }
+            size_t header = s.size() < 0xFF ? 1 : 5;
+            if (chars.size() + header + s.size() >= EMPTY) {
+                throw std::length_error("String arena is full");
+            }
+            uint32_t id = chars.size();
+            if (header == 1) {
+                chars.push_back((char)s.size());
+            } else {
+                uint32_t length = s.size();
+                chars.push_back((char)0xFF);
+                chars.append((const char*)&length, 4);
+            }
+            chars.append(s);
+            table[i] = id;
+            count++;
+            return id;
+        }
+        std::string_view Get(uint32_t id) const {
+            const char* p = chars.data() + id;
+            uint32_t length = (uint8_t)*p++;
+            if (length == 0xFF) {
+                memcpy(&length, p, 4);
+                p += 4;
+            }
+            return {p, length};
+        }
+
+        // Room for the given number of strings and bytes of them.
+        void Reserve(size_t strings, size_t bytes) {
+            size_t size = 64;
+            while (strings * 4 > size * 3) {
+                size *= 2;
+            }
+            if (size > table.size()) {
+                Rehash(size);
+            }
+            chars.reserve(bytes);
+        }
+        // Distinct strings.
+        size_t Size() const {
+            return count;
+        }
+        // Bytes in use by strings and by the index.
+        size_t GetBytes() const {
+            return chars.size() + table.size() * sizeof(uint32_t);
+        }
+        void Clear() {
+            chars.clear();
+            table.clear();
+            count = 0;
+        }
+
+    private:
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+
+        static size_t Hash(std::string_view s) {
+            uint32_t h = 2166136261u; // FNV-1a
+            for (char c : s) {
+                h = (h ^ (uint8_t)c) * 16777619u;
+            }
+            return h;
         }
 
-        Record operator[](size_t i) {
-            if (_history.size() > i) {
-                for (auto it = _history.begin(); it != _history.end(); it++) {
-                    if (i == 0) {
-                        return *it;
+        void Rehash(size_t size) {
+            std::vector<uint32_t> old(size, EMPTY);
+            old.swap(table);
+            for (uint32_t id : old) {
+                if (id != EMPTY) {
+                    size_t i = Hash(Get(id)) & (size - 1);
+                    while (table[i] != EMPTY) {
+                        i = (i + 1) & (size - 1);
                     }
-                    i--;
+                    table[i] = id;
                 }
             }
-            throw std::out_of_range("Index: " + std::to_string(i));
         }
-        void AddRecord(int p1, int p2, const std::string& n1, const std::string& n2) {
-            _history.push_back({p1, p2, n1, n2});
+
+        std::string chars;
+        // open addressing, power of two size, at most 3/4 full
+        std::vector<uint32_t> table;
+        size_t count = 0;
+    };
+
+    // Posting lists of the serials of the records whose number holds
+    // each symbol, pair and trigram of symbols, over the number with a
+    // '^' in front so that prefixes have grams of their own. Serials are
+    // added in increasing order, so lists stay sorted; serials of evicted
+    // records are skipped by Candidates() until the owner rebuilds the
+    // index.
+    //
+    // A list is a chain of 64 byte chunks: the first serial, then varint
+    // tokens of gaps to the next serial (even) or of runs of consecutive
+    // serials (odd), a zero byte ends the chunk. A symbol or pair held by
+    // most numbers costs a few bits per record instead of a u32.
+    class TGramIndex {
+    public:
+        void Add(uint32_t serial, std::string_view number) {
+            if (lists.empty()) {
+                lists.resize(GRAMS);
+            }
+            int a = -1;
+            int b = 0;
+            for (char c : number) {
+                int code = Code(c);
+                Post(serial, UNIGRAMS + code);
+                Post(serial, BIGRAMS + b * CODES + code);
+                if (a >= 0) {
+                    Post(serial, (a * CODES + b) * CODES + code);
+                }
+                a = b;
+                b = code;
+            }
+        }
+
+        // Grams a number (atStart) or any part of it must hold: its
+        // trigrams, or the one pair or symbol of a shorter text.
+        static std::vector<uint32_t> Grams(std::string_view text, bool atStart) {
+            std::vector<uint32_t> grams;
+            if (text.empty()) {
+                return grams;
+            }
+            size_t symbols = text.size() + atStart;
+            if (symbols == 1) {
+                grams.push_back(UNIGRAMS + Code(text[0]));
+                return grams;
+            }
+            int a = atStart ? 0 : -1;
+            int b = -1;
+            for (char c : text) {
+                int code = Code(c);
+                if (symbols == 2 && (b >= 0 || atStart)) {
+                    grams.push_back(BIGRAMS + (b >= 0 ? b : 0) * CODES + code);
+                } else if (a >= 0 && b >= 0) {
+                    grams.push_back((a * CODES + b) * CODES + code);
+                }
+                a = b;
+                b = code;
+                if (a < 0 && atStart) {
+                    a = 0;
+                }
+            }
+            return grams;
         }
 
+        // Calls visit(serial) for the serials from first on that hold
+        // every one of grams, newest first, until it returns false.
+        template <typename F>
+        void Candidates(const std::vector<uint32_t>& grams, uint32_t first, F&& visit) const {
+            std::vector<TCursor> cursors;
+            for (uint32_t gram : grams) {
+                if (lists.empty() || lists[gram].count == 0) {
+                    return;
+                }
+                cursors.emplace_back(*this, lists[gram]);
+            }
+            std::sort(cursors.begin(), cursors.end(), [](const TCursor& x, const TCursor& y) {
+                return x.list->count < y.list->count;
+            });
+            const TList& shortest = *cursors[0].list;
+            std::vector<TSpan> spans;
+            for (size_t c = shortest.chunks.size(); c-- > 0;) {
+                Decode(shortest.chunks[c], spans);
+                for (size_t s = spans.size(); s-- > 0;) {
+                    for (uint32_t serial = spans[s].last;; serial--) {
+                        if (serial < first) {
+                            return;
+                        }
+                        bool all = true;
+                        for (size_t r = 1; r < cursors.size() && all; r++) {
+                            all = cursors[r].Holds(serial);
+                        }
+                        if (all && !visit(serial)) {
+                            return;
+                        }
+                        if (serial == spans[s].first) {
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        size_t GetEntries() const {
+            return entries;
+        }
+        // Heap bytes of the lists.
+        size_t GetBytes() const {
+            size_t bytes = lists.capacity() * sizeof(TList) + pages.capacity() * sizeof(pages[0]) +
+                           pages.size() * PAGE_CHUNKS * CHUNK;
+            for (const TList& list : lists) {
+                bytes += list.chunks.capacity() * sizeof(uint32_t);
+            }
+            return bytes;
+        }
         void Clear() {
-            _history.clear();
+            lists.clear();
+            pages.clear();
+            chunks = 0;
+            entries = 0;
         }
 
-        std::vector<std::string> Get() {
-            std::vector<std::string> l;
-            for (auto& r : _history) {
-                l.push_back(r.ToString());
+    private:
+        // '^', 16 digits, '.', '-' and anything else
+        static const int CODES = 20;
+        // trigrams first, then pairs, then single symbols
+        static const size_t BIGRAMS = CODES * CODES * CODES;
+        static const size_t UNIGRAMS = BIGRAMS + CODES * CODES;
+        static const size_t GRAMS = UNIGRAMS + CODES;
+        // bytes of a chunk, the first 4 hold its first serial
+        static const size_t CHUNK = 64;
+        static const size_t PAGE_CHUNKS = 1024;
+        static const uint8_t NO_RUN = 0xFF;
+
+        struct TList {
+            std::vector<uint32_t> chunks;
+            uint32_t count = 0;
+            uint32_t last = 0;
+            // the run token being extended in the last chunk
+            uint32_t run = 0;
+            uint8_t runAt = NO_RUN;
+            uint8_t used = 0;
+        };
+        // serials first..last
+        struct TSpan {
+            uint32_t first;
+            uint32_t last;
+        };
+
+        // Membership of serials asked in decreasing order.
+        struct TCursor {
+            TCursor(const TGramIndex& index, const TList& list)
+                : index(&index)
+                , list(&list) {
+            }
+            bool Holds(uint32_t serial) {
+                if (!decoded || serial < chunkFirst) {
+                    const std::vector<uint32_t>& chunks = list->chunks;
+                    auto it = std::upper_bound(chunks.begin(), chunks.end(), serial, [this](uint32_t x, uint32_t id) {
+                        return x < index->First(id);
+                    });
+                    if (it == chunks.begin()) {
+                        return false;
+                    }
+                    decoded = true;
+                    chunkFirst = index->First(*--it);
+                    index->Decode(*it, spans);
+                    span = spans.size();
+                }
+                while (span > 0 && spans[span - 1].first > serial) {
+                    span--;
+                }
+                return span > 0 && spans[span - 1].last >= serial;
+            }
+
+            const TGramIndex* index;
+            const TList* list;
+            bool decoded = false;
+            uint32_t chunkFirst = 0;
+            std::vector<TSpan> spans;
+            size_t span = 0;
+        };
+
+        uint8_t* Chunk(uint32_t id) const {
+            return pages[id / PAGE_CHUNKS].get() + id % PAGE_CHUNKS * CHUNK;
+        }
+        uint32_t First(uint32_t id) const {
+            uint32_t serial;
+            memcpy(&serial, Chunk(id), 4);
+            return serial;
+        }
+        void Decode(uint32_t id, std::vector<TSpan>& spans) const {
+            spans.clear();
+            const uint8_t* p = Chunk(id) + 4;
+            const uint8_t* end = Chunk(id) + CHUNK;
+            TSpan span = {First(id), First(id)};
+            while (p != end && *p != 0) {
+                uint32_t v = 0;
+                for (int shift = 0;; shift += 7) {
+                    v |= uint32_t(*p & 0x7F) << shift;
+                    if (!(*p++ & 0x80)) {
+                        break;
+                    }
+                }
+                if (v & 1) {
+                    span.last += v >> 1;
+                } else {
+                    spans.push_back(span);
+                    span.first = span.last = span.last + (v >> 1);
+                }
             }
-            return l;
+            spans.push_back(span);
         }
 
-        int Count() {
+        static size_t VarintSize(uint32_t v) {
+            size_t size = 1;
+            while (v >= 0x80) {
+                v >>= 7;
+                size++;
+            }
+            return size;
+        }
+        static void PutVarint(uint8_t* p, uint32_t v) {
+            for (; v >= 0x80; v >>= 7) {
+                *p++ = uint8_t(v | 0x80);
+            }
+            *p = uint8_t(v);
+        }
+        // Writes token v at byte at of the last chunk when it fits.
+        bool Put(TList& list, size_t at, uint32_t v) {
+            size_t size = VarintSize(v);
+            if (at + size > CHUNK - 4) {
+                return false;
+            }
+            PutVarint(Chunk(list.chunks.back()) + 4 + at, v);
+            list.used = at + size;
+            return true;
+        }
+
+        // Encodes the gap to the next serial in the last chunk, false when
+        // the list needs a new chunk.
+        bool Append(TList& list, uint32_t gap) {
+            if (list.count == 0) {
+                return false;
+            }
+            if (gap == 1 && list.runAt != NO_RUN) {
+                if (!Put(list, list.runAt, (list.run + 1) << 1 | 1)) {
+                    return false;
+                }
+                list.run++;
+                return true;
+            }
+            size_t at = list.used;
+            if (!Put(list, at, gap == 1 ? 3 : gap << 1)) {
+                return false;
+            }
+            list.runAt = gap == 1 ? at : NO_RUN;
+            list.run = 1;
+            return true;
+        }
+
+        void Post(uint32_t serial, size_t gram) {
+            TList& list = lists[gram];
+            if (list.count != 0 && list.last == serial) {
+                return;
+            }
+            entries++;
+            if (!Append(list, serial - list.last)) {
+                if (chunks % PAGE_CHUNKS == 0) {
+                    pages.emplace_back(new uint8_t[PAGE_CHUNKS * CHUNK]());
+                }
+                list.chunks.push_back(chunks++);
+                memcpy(Chunk(list.chunks.back()), &serial, 4);
+                list.used = 0;
+                list.runAt = NO_RUN;
+            }
+            list.last = serial;
+            list.count++;
+        }
+
+        static int Code(char c) {
+            if (c >= '0' && c <= '9') {
+                return 1 + c - '0';
+            }
+            if (c >= 'A' && c <= 'F') {
+                return 11 + c - 'A';
+            }
+            return c == '.' ? 17 : c == '-' ? 18 : 19;
+        }
+
+        std::vector<TList> lists;
+        // chunks of all lists, PAGE_CHUNKS to a page
+        std::vector<std::unique_ptr<uint8_t[]>> pages;
+        uint32_t chunks = 0;
+        size_t entries = 0;
+    };
+
+    // THistory::Search() arguments, the defaults match every record.
+    struct TQuery {
+        std::string text;
+        bool prefix = false; // text starts the number, not just occurs in it
+        bool source = true;  // look for text in number1
+        bool result = true;  // and in number2
+        int radix1 = 0;      // 0 is any radix
+        int radix2 = 0;
+        size_t limit = 0; // only the newest matches, 0 is all
+    };
+
+    // What AddRecord() does when the history is full.
+    enum struct TEviction : uint8_t {
+        DropOldest, // the new record overwrites the oldest one
+        RejectNew,  // the new record is not added
+    };
+
+    // Fixed capacity ring buffer of records, [0] is the oldest one kept.
+    // A record is 12 bytes of radices and arena offsets of its numbers,
+    // repeated numbers are stored once. Once evicted numbers make up half
+    // of the arena it is rebuilt from the records kept. Numbers are also
+    // indexed by n-grams for Search(), record i has serial first + i.
+    class THistory {
+    public:
+        explicit THistory(size_t capacity = HISTORY_CAPACITY, TEviction eviction = TEviction::DropOldest)
+            : capacity(capacity)
+            , eviction(eviction) {
+            if (capacity == 0) {
+                throw std::invalid_argument("History capacity: 0");
+            }
+        }
+
+        // Rows of the history as Record::ToString(), formatted only when
+        // a row is read.
+        class TView {
+        public:
+            explicit TView(const THistory& history)
+                : history(history) {
+            }
+            size_t Size() const {
+                return history.Count();
+            }
+            std::string operator[](size_t i) const {
+                const TSlot& s = history.Slot(i);
+                return Record::Format(s.radix1, s.radix2, history.arena.Get(s.number1), history.arena.Get(s.number2));
+            }
+
+        private:
+            const THistory& history;
+        };
+
+        Record operator[](size_t i) const {
+            const TSlot& s = Slot(i);
+            return {s.radix1, s.radix2, std::string(arena.Get(s.number1)), std::string(arena.Get(s.number2))};
+        }
+        // false when the history is full and rejects new records
+        bool AddRecord(int p1, int p2, const std::string& n1, const std::string& n2) {
+            if (p1 < 0 || p1 > UINT8_MAX || p2 < 0 || p2 > UINT8_MAX) {
+                throw std::invalid_argument("History radix: " + std::to_string(p1) + ", " + std::to_string(p2));
+            }
+            if (_history.size() < capacity) {
+                _history.push_back({arena.Intern(n1), arena.Intern(n2), (uint8_t)p1, (uint8_t)p2});
+                Index(first + _history.size() - 1, _history.back());
+                return true;
+            }
+            evicted++;
+            if (eviction == TEviction::RejectNew) {
+                return false;
+            }
+            _history[head] = {arena.Intern(n1), arena.Intern(n2), (uint8_t)p1, (uint8_t)p2};
+            Index(first + _history.size(), _history[head]);
+            head = head + 1 == capacity ? 0 : head + 1;
+            first++;
+            if (arena.GetBytes() > 2 * compacted + 4096) {
+                Compact();
+            }
+            size_t entries = sourceIndex.GetEntries() + resultIndex.GetEntries();
+            if (entries > 2 * indexed + 4096 || first > UINT32_MAX / 2) {
+                Reindex();
+            }
+            return true;
+        }
+
+        // Indices of the records that match q, in increasing order. Text
+        // is looked up in the index, radices alone are checked record by
+        // record from the newest one.
+        std::vector<size_t> Search(const TQuery& q) const {
+            std::vector<uint32_t> grams = TGramIndex::Grams(q.text, q.prefix);
+            std::vector<size_t> found;
+            auto match = [&](size_t i) {
+                const TSlot& s = Slot(i);
+                if ((q.radix1 != 0 && s.radix1 != q.radix1) || (q.radix2 != 0 && s.radix2 != q.radix2)) {
+                    return false;
+                }
+                auto has = [&](uint32_t id) {
+                    std::string_view number = arena.Get(id);
+                    return q.prefix ? number.substr(0, q.text.size()) == q.text
+                                    : number.find(q.text) != std::string_view::npos;
+                };
+                return (q.source && has(s.number1)) || (q.result && has(s.number2));
+            };
+            auto full = [&] {
+                return q.limit != 0 && found.size() == q.limit;
+            };
+            if (grams.empty()) {
+                for (size_t i = _history.size(); i-- > 0 && !full();) {
+                    if (match(i)) {
+                        found.push_back(i);
+                    }
+                }
+                std::reverse(found.begin(), found.end());
+                return found;
+            }
+            // newest matches of each field, then the newest of both
+            std::vector<size_t> fields[2];
+            const TGramIndex* indices[2] = {q.source ? &sourceIndex : NULL, q.result ? &resultIndex : NULL};
+            for (int f = 0; f < 2; f++) {
+                if (indices[f] == NULL) {
+                    continue;
+                }
+                indices[f]->Candidates(grams, first, [&](uint32_t serial) {
+                    if (match(serial - first)) {
+                        found.push_back(serial - first);
+                    }
+                    return !full();
+                });
+                fields[f].assign(found.rbegin(), found.rend());
+                found.clear();
+            }
+            std::set_union(fields[0].begin(), fields[0].end(), fields[1].begin(), fields[1].end(),
+                           std::back_inserter(found));
+            if (q.limit != 0 && found.size() > q.limit) {
+                found.erase(found.begin(), found.end() - q.limit);
+            }
+            return found;
+        }
+
+        void Clear() {
+            _history.clear();
+            arena.Clear();
+            sourceIndex.Clear();
+            resultIndex.Clear();
+            head = 0;
+            compacted = 0;
+            first = 0;
+            indexed = 0;
+        }
+
+        TView Get() const {
+            return TView(*this);
+        }
+
+        int Count() const {
             return _history.size();
         }
+        size_t GetCapacity() const {
+            return capacity;
+        }
+        // Records dropped or rejected because the history was full.
+        uint64_t GetEvicted() const {
+            return evicted;
+        }
+        // Heap bytes used by the records and their numbers.
+        size_t GetBytes() const {
+            return _history.capacity() * sizeof(TSlot) + arena.GetBytes();
+        }
+        // Heap bytes used by the search index.
+        size_t GetIndexBytes() const {
+            return sourceIndex.GetBytes() + resultIndex.GetBytes();
+        }
 
     private:
-        std::list<Record> _history;
+        struct TSlot {
+            uint32_t number1;
+            uint32_t number2;
+            uint8_t radix1;
+            uint8_t radix2;
+        };
+
+        const TSlot& Slot(size_t i) const {
+            if (i >= _history.size()) {
+                throw std::out_of_range("Index: " + std::to_string(i));
+            }
+            i += head;
+            return _history[i < _history.size() ? i : i - _history.size()];
+        }
+
+        void Index(uint32_t serial, const TSlot& s) {
+            sourceIndex.Add(serial, arena.Get(s.number1));
+            resultIndex.Add(serial, arena.Get(s.number2));
+        }
+
+        // Drops the serials of evicted records, numbering from 0 again.
+        void Reindex() {
+            sourceIndex.Clear();
+            resultIndex.Clear();
+            first = 0;
+            for (size_t i = 0; i < _history.size(); i++) {
+                Index(i, Slot(i));
+            }
+            indexed = sourceIndex.GetEntries() + resultIndex.GetEntries();
+        }
+
+        void Compact() {
+            TStringArena live;
+            live.Reserve(arena.Size(), arena.GetBytes());
+            for (TSlot& s : _history) {
+                s.number1 = live.Intern(arena.Get(s.number1));
+                s.number2 = live.Intern(arena.Get(s.number2));
+            }
+            std::swap(arena, live);
+            compacted = arena.GetBytes();
+        }
+
+        size_t capacity;
+        TEviction eviction;
+        size_t head = 0;
+        uint64_t evicted = 0;
+        std::vector<TSlot> _history;
+        TStringArena arena;
+        // arena size after the last Compact()
+        size_t compacted = 0;
+        TGramIndex sourceIndex;
+        TGramIndex resultIndex;
+        // serial of [0]
+        uint32_t first = 0;
+        // index entries after the last Reindex()
+        size_t indexed = 0;
     }; // class THistory
 } // namespace NHistory
 
 #ifdef RUN_TESTS
 #include "acutest.h"
+#include "pnumber.cc"
+#include <random>
 
 void test_history() {
     using namespace std;
@@ -103,5 +701,220 @@ void test_history() {
     TEST_CHECK(h.Count() == 0);
 }
 
+void test_history_ring() {
+    using namespace std;
+    using namespace NHistory;
+    auto add = [](THistory& h, int from, int to) {
+        for (int i = from; i < to; i++) {
+            h.AddRecord(10, 16, to_string(i), to_string(i * 2));
+        }
+    };
+    TEST_CASE("DropOldest");
+    {
+        THistory h(3);
+        add(h, 0, 2);
+        TEST_CHECK(h.Count() == 2 && h[1].number1 == "1");
+        add(h, 2, 7);
+        TEST_CHECK(h.Count() == 3 && h.GetEvicted() == 4);
+        TEST_CHECK(h[0].number1 == "4" && h[1].number1 == "5" && h[2].number1 == "6");
+        THistory::TView rows = h.Get();
+        TEST_CHECK(rows.Size() == 3 && rows[0] == h[0].ToString() && rows[2] == h[2].ToString());
+        TEST_EXCEPTION(h[3], out_of_range);
+        h.Clear();
+        add(h, 7, 8);
+        TEST_CHECK(h.Count() == 1 && h[0].number1 == "7");
+    }
+    TEST_CASE("RejectNew");
+    {
+        THistory h(2, TEviction::RejectNew);
+        add(h, 0, 2);
+        TEST_CHECK(!h.AddRecord(2, 2, "1", "1"));
+        TEST_CHECK(h.Count() == 2 && h[0].number1 == "0" && h[1].number1 == "1");
+        TEST_CHECK(h.GetEvicted() == 1);
+    }
+    TEST_EXCEPTION(THistory(0), invalid_argument);
+    TEST_EXCEPTION(THistory().AddRecord(256, 2, "1", "1"), invalid_argument);
+}
+
+void test_history_arena() {
+    using namespace std;
+    using namespace NHistory;
+    TEST_CASE("Interning");
+    {
+        TStringArena a;
+        uint32_t x = a.Intern("1F.8");
+        string big(300, 'A');
+        uint32_t y = a.Intern(big);
+        TEST_CHECK(a.Intern("1F.8") == x && a.Intern(big) == y && a.Size() == 2);
+        TEST_CHECK(a.Get(x) == "1F.8" && a.Get(y) == big && a.Get(a.Intern("")) == "");
+        for (int i = 0; i < 1000; i++) {
+            a.Intern(to_string(i));
+        }
+        TEST_CHECK(a.Get(x) == "1F.8" && a.Intern("999") == a.Intern(string("999")) && a.Size() == 1003);
+    }
+    TEST_CASE("Evicted numbers are dropped");
+    {
+        THistory h(100);
+        for (int i = 0; i < 100000; i++) {
+            h.AddRecord(10, 2, to_string(i), "1");
+        }
+        TEST_CHECK(h.Count() == 100 && h[0].number1 == "99900" && h[99] == Record({10, 2, "99999", "1"}));
+        TEST_CHECK_(h.GetBytes() < 16384, "%zu", h.GetBytes());
+    }
+}
+
+void test_history_search() {
+    using namespace std;
+    using namespace NHistory;
+    // the same matches as checking every record
+    auto naive = [](const THistory& h, const TQuery& q) {
+        vector<size_t> found;
+        for (size_t i = 0; i < (size_t)h.Count(); i++) {
+            Record r = h[i];
+            auto has = [&](const string& n) {
+                return q.prefix ? n.compare(0, q.text.size(), q.text) == 0 : n.find(q.text) != string::npos;
+            };
+            if ((q.radix1 == 0 || r.radix1 == q.radix1) && (q.radix2 == 0 || r.radix2 == q.radix2) &&
+                ((q.source && has(r.number1)) || (q.result && has(r.number2)))) {
+                found.push_back(i);
+            }
+        }
+        if (q.limit != 0 && found.size() > q.limit) {
+            found.erase(found.begin(), found.end() - q.limit);
+        }
+        return found;
+    };
+    TEST_CASE("Queries");
+    {
+        THistory h(500);
+        mt19937 rng(3);
+        bool same = true;
+        for (int round = 0; round < 3000 && same; round++) {
+            int r1 = 2 + rng() % 15, r2 = 2 + rng() % 15;
+            string n1 = (rng() % 4 ? "" : "-") + to_string(rng() % 100000);
+            h.AddRecord(r1, r2, n1, NPNumber::TPNumber(stold(n1), r2, rng() % 3).ToString());
+            if (round % 50 != 0) {
+                continue;
+            }
+            for (string text : {"", "1", "12", "123", "-4", ".0", "A1", "999", "1.", "10"}) {
+                TQuery q;
+                q.text = text;
+                q.prefix = rng() % 2;
+                q.source = rng() % 3 != 0;
+                q.result = !q.source || rng() % 2;
+                q.radix1 = rng() % 3 ? 0 : r1;
+                q.radix2 = rng() % 3 ? 0 : r2;
+                q.limit = rng() % 3 ? 0 : 5;
+                same = h.Search(q) == naive(h, q);
+                if (!same) {
+                    TEST_MSG("round %d, '%s', prefix %d, source %d, result %d, %d -> %d, limit %zu", round,
+                             text.c_str(), q.prefix, q.source, q.result, q.radix1, q.radix2, q.limit);
+                    break;
+                }
+            }
+        }
+        TEST_CHECK(same);
+    }
+    TEST_CASE("Long gaps and runs");
+    {
+        THistory h(70000);
+        for (int i = 0; i < 70000; i++) {
+            h.AddRecord(10, 2, i % 20000 == 0 || i % 7 == 3 ? "7" : "1", i < 1000 ? "-" : "0");
+        }
+        for (string text : {"7", "1", "-", "0"}) {
+            TQuery q;
+            q.text = text;
+            TEST_CHECK_(h.Search(q) == naive(h, q), "%s", text.c_str());
+            q.limit = 3;
+            TEST_CHECK_(h.Search(q) == naive(h, q), "%s, limit", text.c_str());
+        }
+        TEST_CHECK_(h.GetIndexBytes() < 1024 * 1024, "%zu", h.GetIndexBytes());
+    }
+    TEST_CASE("After Clear");
+    {
+        THistory h;
+        h.AddRecord(10, 16, "255", "FF");
+        h.Clear();
+        h.AddRecord(10, 2, "3", "11");
+        TQuery q;
+        q.text = "FF";
+        q.prefix = true;
+        TEST_CHECK(h.Search(q).empty());
+        q.text = "11";
+        TEST_CHECK(h.Search(q) == vector<size_t>({0}));
+    }
+}
+
 #endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include <list>
+#include <random>
+
+// Filling, indexing and overwriting a history of 10^6 records, its
+// memory and the rows of the history dialog, against a std::list of
+// records the way the history used to be kept.
+void bench_history() {
+    const size_t n = 1000000;
+    auto output = [](size_t i) {
+        return std::to_string(i) + ".5";
+    };
+    size_t before = NBench::HeapInUse();
+    NHistory::THistory h(n);
+    size_t i = 0;
+    NBench::Measure("AddRecord, up to 10^6", n, [&] {
+        h.AddRecord(16, 10, "FF.8", output(i++));
+    });
+    printf("  %-48s %12.2f bytes/record\n", "heap", double(NBench::HeapInUse() - before) / n);
+    printf("  %-48s %12.2f bytes/record\n", "records and arena", double(h.GetBytes()) / n);
+    printf("  %-48s %12.2f bytes/record\n", "index", double(h.GetIndexBytes()) / n);
+    std::mt19937 rng(1);
+    NBench::Measure("operator[], random index", n, [&] {
+        NBench::DoNotOptimize(h[rng() % n].radix1);
+    });
+    NBench::Measure("AddRecord, full, DropOldest", n, [&] {
+        h.AddRecord(16, 10, "FF.8", output(i++));
+    });
+    NBench::Measure("Get(), 20 visible rows", 1000, [&] {
+        NHistory::THistory::TView rows = h.Get();
+        for (size_t row = 0; row < 20; row++) {
+            NBench::DoNotOptimize(rows[rows.Size() - 1 - row]);
+        }
+    });
+    const std::pair<const char*, bool> searches[] = {
+        {"123456", false}, {"1234", false}, {"19", true}, {"1999", true}, {".5", false}, {"77", false}, {"-", false}, {"-1", false}};
+    for (auto search : searches) {
+        NHistory::TQuery q;
+        q.text = search.first;
+        q.prefix = search.second;
+        q.limit = 100;
+        char title[96];
+        snprintf(title, sizeof(title), "Search %s'%s', %zu found", q.prefix ? "prefix " : "", q.text.c_str(),
+                 h.Search(q).size());
+        NBench::Measure(title, 100, [&] {
+            NBench::DoNotOptimize(h.Search(q));
+        });
+    }
+
+    before = NBench::HeapInUse();
+    std::list<NHistory::Record> list;
+    for (size_t k = 0; k < n; k++) {
+        list.push_back({16, 10, "FF.8", output(k)});
+    }
+    printf("  %-48s %12.2f bytes/record\n", "std::list heap", double(NBench::HeapInUse() - before) / n);
+    NBench::Measure("std::list walk, random index", 100, [&] {
+        auto it = list.begin();
+        std::advance(it, rng() % n);
+        NBench::DoNotOptimize(it->radix1);
+    });
+    NBench::Measure("std::list, all rows ToString()", 3, [&] {
+        std::vector<std::string> rows;
+        for (auto& r : list) {
+            rows.push_back(r.ToString());
+        }
+        NBench::DoNotOptimize(rows);
+    });
+}
+#endif // #ifdef RUN_BENCH
 #endif // #ifndef HISTORY_CC
@@ -0,0 +1,598 @@
+#ifndef HISTORYLOG_CC
+#define HISTORYLOG_CC
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.cc"
+
+// Append-only history file. After an 8 byte magic every record is
+//   [u32 size][u32 crc32 of payload][payload][u32 size]
+// with payload [u8 radix1][u8 radix2][u16 length of number1][number1][number2].
+// The trailing size lets the file be read from its end without an index.
+namespace NHistory {
+    static const char HISTORY_LOG_MAGIC[8] = {'C', 'A', 'L', 'C', 'H', 'S', 'T', '1'};
+    static const size_t HISTORY_LOG_OVERHEAD = 12;
+
+    class history_log_error : public std::runtime_error {
+    public:
+        explicit history_log_error(const std::string& message)
+            : std::runtime_error(message) {
+        }
+    };
+
+    inline uint32_t Crc32(const char* data, size_t size) {
+        static const std::vector<uint32_t> table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    // The file is mapped, not read: opening a clean log checks only its
+    // last record, the records are counted and their offsets found on
+    // first use. A last record cut short by a crash is found by a scan
+    // of the record sizes from the start and truncated away; a checksum
+    // mismatch is only an error when the record is read. Records are
+    // appended with one O_APPEND write() under flock(), so converters
+    // sharing the file do not overwrite each other.
+    class THistoryLog {
+    public:
+        explicit THistoryLog(const std::string& path, bool sync = false)
+            : path(path)
+            , sync(sync) {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                Fail("open");
+            }
+            try {
+                TLock lock(*this);
+                Init();
+            } catch (...) {
+                Close();
+                throw;
+            }
+        }
+        ~THistoryLog() {
+            Close();
+        }
+        THistoryLog(const THistoryLog&) = delete;
+        THistoryLog& operator=(const THistoryLog&) = delete;
+
+        void Append(const Record& r) {
+            if (r.radix1 < 0 || r.radix1 > 255 || r.radix2 < 0 || r.radix2 > 255 ||
+                r.number1.size() > UINT16_MAX || r.number1.size() + r.number2.size() > UINT32_MAX / 2) {
+                throw std::invalid_argument("History record: " + r.ToString());
+            }
+            uint32_t size = 4 + r.number1.size() + r.number2.size();
+            std::string buffer(HISTORY_LOG_OVERHEAD + size, '\0');
+            char* p = &buffer[0];
+            Put32(p, size);
+            p[8] = (char)r.radix1;
+            p[9] = (char)r.radix2;
+            uint16_t length1 = r.number1.size();
+            memcpy(p + 10, &length1, 2);
+            memcpy(p + 12, r.number1.data(), r.number1.size());
+            memcpy(p + 12 + r.number1.size(), r.number2.data(), r.number2.size());
+            Put32(p + 4, Crc32(p + 8, size));
+            Put32(p + 8 + size, size);
+            TLock lock(*this);
+            if (write(fd, p, buffer.size()) != (ssize_t)buffer.size()) {
+                Fail("write");
+            }
+            if (sync && fdatasync(fd) != 0) {
+                Fail("fdatasync");
+            }
+            off_t after = lseek(fd, 0, SEEK_CUR);
+            if (after < 0) {
+                Fail("lseek");
+            }
+            uint64_t offset = after - buffer.size();
+            if (scanned == end && offset == end) {
+                offsets.push_back(offset);
+                scanned = after;
+            }
+            // another process appended since, count again when asked
+            counted = counted && offset == end;
+            if (counted) {
+                count++;
+            }
+            end = after;
+        }
+
+        // Record i from the oldest, throws history_log_error when its
+        // checksum does not match.
+        Record operator[](size_t i) {
+            if (i >= Count()) {
+                throw std::out_of_range("Index: " + std::to_string(i));
+            }
+            Map();
+            while (offsets.size() <= i) {
+                uint64_t next = Next(scanned);
+                if (next > end) {
+                    throw history_log_error(path + ": corrupted record at " + std::to_string(scanned));
+                }
+                offsets.push_back(scanned);
+                scanned = next;
+            }
+            return Read(offsets[i]);
+        }
+        // The last n records (all when there are fewer), oldest first,
+        // read from the end of the file. Records whose checksum does not
+        // match are skipped and counted in GetCorrupted(); so is a region
+        // with damaged sizes, which Scan() finds from the start.
+        std::vector<Record> Tail(size_t n) {
+            Map();
+            std::vector<Record> result;
+            auto take = [&](uint64_t offset) {
+                if (offset == DAMAGED || !Valid(offset)) {
+                    corrupted++;
+                } else {
+                    result.push_back(Read(offset));
+                }
+            };
+            for (uint64_t offset = end; result.size() < n && offset > sizeof(HISTORY_LOG_MAGIC);) {
+                uint64_t prev = Prev(offset);
+                if (!Whole(prev) || Next(prev) != offset) {
+                    std::vector<uint64_t> before = Scan(offset);
+                    for (size_t i = before.size(); i-- > 0 && result.size() < n;) {
+                        take(before[i]);
+                    }
+                    break;
+                }
+                take(prev);
+                offset = prev;
+            }
+            std::reverse(result.begin(), result.end());
+            return result;
+        }
+
+        // Walks the whole file on the first call, and again after another
+        // process appended to it.
+        size_t Count() {
+            if (!counted) {
+                TLock lock(*this);
+                struct stat st;
+                if (fstat(fd, &st) != 0) {
+                    Fail("fstat");
+                }
+                end = std::max<uint64_t>(end, st.st_size);
+                Map();
+                if (!CountFromEnd()) {
+                    throw history_log_error(path + ": corrupted record sizes");
+                }
+                counted = true;
+            }
+            return count;
+        }
+        // Bytes cut from the end of the file by the constructor.
+        uint64_t GetTruncated() const {
+            return truncated;
+        }
+        // Records skipped by Tail().
+        size_t GetCorrupted() const {
+            return corrupted;
+        }
+        const std::string& GetPath() const {
+            return path;
+        }
+
+    private:
+        void Init() {
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                Fail("fstat");
+            }
+            end = st.st_size;
+            if (end < sizeof(HISTORY_LOG_MAGIC)) {
+                // new file or a crash while creating it
+                truncated = end;
+                Truncate(0);
+                if (write(fd, HISTORY_LOG_MAGIC, sizeof(HISTORY_LOG_MAGIC)) != sizeof(HISTORY_LOG_MAGIC)) {
+                    Fail("write");
+                }
+                end = scanned = sizeof(HISTORY_LOG_MAGIC);
+                counted = true;
+                return;
+            }
+            Map();
+            if (memcmp(data, HISTORY_LOG_MAGIC, sizeof(HISTORY_LOG_MAGIC)) != 0) {
+                throw history_log_error(path + ": not a history log");
+            }
+            scanned = sizeof(HISTORY_LOG_MAGIC);
+            if (end == scanned || Whole(Prev(end))) {
+                return;
+            }
+            // torn tail: keep the records that are whole
+            uint64_t good = scanned;
+            counted = true;
+            while (good < end && Whole(good)) {
+                offsets.push_back(good);
+                good = Next(good);
+                count++;
+            }
+            truncated = end - good;
+            Truncate(good);
+            end = scanned = good;
+        }
+
+        // Counts the records by their trailing sizes, false when they
+        // do not lead back to the first record.
+        bool CountFromEnd() {
+            uint64_t offset = end;
+            count = 0;
+            while (offset > sizeof(HISTORY_LOG_MAGIC)) {
+                if (offset - sizeof(HISTORY_LOG_MAGIC) < HISTORY_LOG_OVERHEAD) {
+                    return false;
+                }
+                uint64_t size = Get32(data + offset - 4);
+                if (offset - sizeof(HISTORY_LOG_MAGIC) < HISTORY_LOG_OVERHEAD + size ||
+                    Get32(data + offset - HISTORY_LOG_OVERHEAD - size) != size) {
+                    return false;
+                }
+                offset -= HISTORY_LOG_OVERHEAD + size;
+                count++;
+            }
+            return true;
+        }
+
+        // Record at offset is in the file and its sizes agree.
+        bool Whole(uint64_t offset) const {
+            if (offset < sizeof(HISTORY_LOG_MAGIC) || offset > end || end - offset < HISTORY_LOG_OVERHEAD) {
+                return false;
+            }
+            uint64_t size = Get32(data + offset);
+            return size >= 4 && end - offset >= HISTORY_LOG_OVERHEAD + size &&
+                   Get32(data + offset + 8 + size) == size &&
+                   Get16(data + offset + 10) <= size - 4;
+        }
+        // Offsets of the whole records before limit, walked from the first
+        // one. A record that is not whole is DAMAGED up to the next valid
+        // record, found byte by byte.
+        std::vector<uint64_t> Scan(uint64_t limit) const {
+            std::vector<uint64_t> found;
+            uint64_t offset = sizeof(HISTORY_LOG_MAGIC);
+            while (offset < limit) {
+                if (Whole(offset) && Next(offset) <= limit) {
+                    found.push_back(offset);
+                    offset = Next(offset);
+                    continue;
+                }
+                found.push_back(DAMAGED);
+                do {
+                    offset++;
+                } while (offset < limit && !(Valid(offset) && Next(offset) <= limit));
+            }
+            return found;
+        }
+
+        // Record at offset is whole and its checksum matches.
+        bool Valid(uint64_t offset) const {
+            return Whole(offset) && Get32(data + offset + 4) == Crc32(data + offset + 8, Get32(data + offset));
+        }
+        uint64_t Next(uint64_t offset) const {
+            return offset + HISTORY_LOG_OVERHEAD + Get32(data + offset);
+        }
+        // Offset of the record that ends at offset, 0 (never valid) when
+        // it would start before the first record.
+        uint64_t Prev(uint64_t offset) const {
+            uint64_t size = HISTORY_LOG_OVERHEAD + Get32(data + offset - 4);
+            return offset - sizeof(HISTORY_LOG_MAGIC) < size ? 0 : offset - size;
+        }
+
+        Record Read(uint64_t offset) {
+            Map();
+            if (!Valid(offset)) {
+                throw history_log_error(path + ": corrupted record at " + std::to_string(offset));
+            }
+            const char* p = data + offset;
+            uint32_t size = Get32(p);
+            uint16_t length1 = Get16(p + 10);
+            return {(uint8_t)p[8], (uint8_t)p[9],
+                    std::string(p + 12, length1), std::string(p + 12 + length1, size - 4 - length1)};
+        }
+
+        // Maps the whole file, again when appends made it longer.
+        void Map() {
+            if (mapped == end) {
+                return;
+            }
+            if (data != NULL) {
+                munmap((void*)data, mapped);
+            }
+            void* m = mmap(NULL, end, PROT_READ, MAP_SHARED, fd, 0);
+            if (m == MAP_FAILED) {
+                data = NULL;
+                mapped = 0;
+                Fail("mmap");
+            }
+            data = (const char*)m;
+            mapped = end;
+        }
+
+        void Truncate(uint64_t size) {
+            if (ftruncate(fd, size) != 0) {
+                Fail("ftruncate");
+            }
+            if (data != NULL && mapped > size) {
+                munmap((void*)data, mapped);
+                data = NULL;
+                mapped = 0;
+            }
+        }
+
+        // Exclusive flock() for the scope, between the processes that
+        // share the file.
+        struct TLock {
+            explicit TLock(const THistoryLog& log)
+                : log(log) {
+                while (flock(log.fd, LOCK_EX) != 0) {
+                    if (errno != EINTR) {
+                        log.Fail("flock");
+                    }
+                }
+            }
+            ~TLock() {
+                flock(log.fd, LOCK_UN);
+            }
+            const THistoryLog& log;
+        };
+
+        void Close() {
+            if (data != NULL) {
+                munmap((void*)data, mapped);
+                data = NULL;
+            }
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        [[noreturn]] void Fail(const char* what) const {
+            throw history_log_error(path + ": " + what + ": " + strerror(errno));
+        }
+
+        static uint32_t Get32(const char* p) {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+        static uint16_t Get16(const char* p) {
+            uint16_t v;
+            memcpy(&v, p, 2);
+            return v;
+        }
+        static void Put32(char* p, uint32_t v) {
+            memcpy(p, &v, 4);
+        }
+
+        std::string path;
+        bool sync;
+        int fd = -1;
+        const char* data = NULL;
+        uint64_t mapped = 0;
+        uint64_t end = 0;
+        uint64_t truncated = 0;
+        size_t corrupted = 0;
+        size_t count = 0;
+        bool counted = false;
+        // offsets of the first records, up to scanned
+        std::vector<uint64_t> offsets;
+        uint64_t scanned = 0;
+
+        // a region Scan() skipped
+        static constexpr uint64_t DAMAGED = UINT64_MAX;
+    };
+} // namespace NHistory
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+
+void test_history_log() {
+    using namespace NHistory;
+    std::string path = "/tmp/test_history_log." + std::to_string(getpid());
+    auto record = [](int i) {
+        return Record{i % 15 + 2, 16, std::to_string(i), std::string(i % 7, 'F')};
+    };
+    remove(path.c_str());
+
+    TEST_CASE("Append and reopen");
+    {
+        {
+            THistoryLog log(path);
+            TEST_CHECK(log.Count() == 0);
+            for (int i = 0; i < 100; i++) {
+                log.Append(record(i));
+            }
+            TEST_CHECK(log.Count() == 100 && log[42] == record(42));
+        }
+        THistoryLog log(path);
+        TEST_CHECK(log.Count() == 100 && log.GetTruncated() == 0);
+        TEST_CHECK(log[99] == record(99) && log[0] == record(0));
+        std::vector<Record> tail = log.Tail(3);
+        TEST_CHECK(tail.size() == 3 && tail[0] == record(97) && tail[2] == record(99));
+        TEST_CHECK(log.Tail(1000).size() == 100);
+        log.Append(record(100));
+        TEST_CHECK(log[100] == record(100) && log.Tail(1)[0] == record(100));
+        TEST_EXCEPTION(log[101], std::out_of_range);
+        TEST_EXCEPTION(log.Append(Record{300, 2, "1", "1"}), std::invalid_argument);
+    }
+    TEST_CASE("Torn last record is truncated");
+    {
+        struct stat st;
+        stat(path.c_str(), &st);
+        TEST_CHECK(truncate(path.c_str(), st.st_size - 3) == 0);
+        {
+            THistoryLog log(path);
+            TEST_CHECK(log.Count() == 100 && log.GetTruncated() > 0);
+            TEST_CHECK(log.Tail(1)[0] == record(99));
+            log.Append(record(7));
+        }
+        THistoryLog log(path);
+        TEST_CHECK(log.Count() == 101 && log.GetTruncated() == 0 && log[100] == record(7));
+    }
+    TEST_CASE("Corrupted record");
+    {
+        {
+            int fd = open(path.c_str(), O_RDWR);
+            TEST_CHECK(pwrite(fd, "X", 1, sizeof(HISTORY_LOG_MAGIC) + 12) == 1);
+            close(fd);
+        }
+        THistoryLog log(path);
+        TEST_CHECK(log.Count() == 101);
+        TEST_EXCEPTION(log[0], history_log_error);
+        TEST_CHECK(log[1] == record(1));
+        TEST_CHECK(log.Tail(1000).size() == 100 && log.GetCorrupted() == 1);
+    }
+    TEST_CASE("Corrupted record before a torn tail");
+    {
+        struct stat st;
+        stat(path.c_str(), &st);
+        {
+            // a bit flip in the payload of record 50
+            THistoryLog log(path);
+            std::vector<Record> all = log.Tail(1000);
+            int fd = open(path.c_str(), O_RDWR);
+            uint64_t offset = sizeof(HISTORY_LOG_MAGIC);
+            for (int i = 0; i < 50; i++) {
+                uint32_t size;
+                TEST_CHECK(pread(fd, &size, 4, offset) == 4);
+                offset += HISTORY_LOG_OVERHEAD + size;
+            }
+            TEST_CHECK(pwrite(fd, "\x7F", 1, offset + 13) == 1);
+            close(fd);
+        }
+        TEST_CHECK(truncate(path.c_str(), st.st_size - 3) == 0);
+        THistoryLog log(path);
+        TEST_CHECK(log.Count() == 100 && log.GetTruncated() > 0);
+        TEST_EXCEPTION(log[50], history_log_error);
+        TEST_CHECK(log[51] == record(51) && log[99] == record(99));
+        std::vector<Record> tail = log.Tail(60);
+        TEST_CHECK(tail.size() == 60 && log.GetCorrupted() == 1);
+        TEST_CHECK(tail[0] == record(39) && tail.back() == record(99));
+    }
+    TEST_CASE("Damaged sizes");
+    {
+        remove(path.c_str());
+        {
+            THistoryLog log(path);
+            for (int i = 0; i < 100; i++) {
+                log.Append(record(i));
+            }
+        }
+        {
+            // the leading size of record 50, the trailing one of record 70
+            int fd = open(path.c_str(), O_RDWR);
+            std::vector<uint64_t> offsets = {sizeof(HISTORY_LOG_MAGIC)};
+            for (int i = 0; i < 100; i++) {
+                uint32_t size;
+                TEST_CHECK(pread(fd, &size, 4, offsets.back()) == 4);
+                offsets.push_back(offsets.back() + HISTORY_LOG_OVERHEAD + size);
+            }
+            uint32_t bad = 0x7FFF;
+            TEST_CHECK(pwrite(fd, &bad, 4, offsets[50]) == 4);
+            bad = 5;
+            TEST_CHECK(pwrite(fd, &bad, 4, offsets[71] - 4) == 4);
+            close(fd);
+        }
+        {
+            THistoryLog log(path);
+            TEST_CHECK(log.Tail(29).size() == 29 && log.GetCorrupted() == 0);
+        }
+        {
+            THistoryLog log(path);
+            std::vector<Record> tail = log.Tail(35);
+            TEST_CHECK(tail.size() == 35 && log.GetCorrupted() == 1);
+            TEST_CHECK(tail[0] == record(64) && tail[6] == record(71) && tail.back() == record(99));
+        }
+        THistoryLog log(path);
+        std::vector<Record> all = log.Tail(1000);
+        TEST_CHECK(all.size() == 98 && log.GetCorrupted() == 2);
+        TEST_CHECK(all[49] == record(49) && all[50] == record(51) && all[68] == record(69) && all[69] == record(71));
+    }
+    TEST_CASE("Two logs on one file");
+    {
+        remove(path.c_str());
+        {
+            THistoryLog a(path), b(path);
+            for (int i = 0; i < 50; i++) {
+                a.Append(record(2 * i));
+                b.Append(record(2 * i + 1));
+            }
+            TEST_CHECK(a.Count() == 100 && b.Count() == 100);
+            TEST_CHECK(a[0] == record(0) && a[1] == record(1) && b[98] == record(98));
+        }
+        THistoryLog log(path);
+        TEST_CHECK(log.Count() == 100 && log.GetTruncated() == 0);
+        bool ordered = true;
+        for (int i = 0; i < 100; i++) {
+            ordered = ordered && log[i] == record(i);
+        }
+        TEST_CHECK(ordered);
+    }
+    TEST_CASE("Not a log");
+    {
+        int fd = open(path.c_str(), O_RDWR | O_TRUNC);
+        TEST_CHECK(write(fd, "0123456789", 10) == 10);
+        close(fd);
+        TEST_EXCEPTION(THistoryLog log(path), history_log_error);
+    }
+    remove(path.c_str());
+}
+#endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+
+// Appending 10^6 records, then opening the log and reading the last
+// HISTORY_CAPACITY of them as TCtrl does at startup.
+void bench_history_log() {
+    const size_t n = 1000000;
+    std::string path = "/tmp/bench_history_log." + std::to_string(getpid());
+    remove(path.c_str());
+    {
+        NHistory::THistoryLog log(path);
+        NHistory::Record r{16, 10, "1FA9C0DE.87", "531218654.527"};
+        NBench::Measure("Append", n, [&] {
+            log.Append(r);
+        });
+    }
+    NBench::Measure("Open 10^6 records + Tail(1024)", 10, [&] {
+        NHistory::THistoryLog log(path);
+        NBench::DoNotOptimize(log.Tail(NHistory::HISTORY_CAPACITY));
+    });
+    NBench::Measure("Open 10^6 records + Count()", 10, [&] {
+        NHistory::THistoryLog log(path);
+        NBench::DoNotOptimize(log.Count());
+    });
+    NHistory::THistoryLog log(path);
+    NBench::Measure("operator[], first access in order", n, [&, i = size_t(0)]() mutable {
+        NBench::DoNotOptimize(log[i++].radix1);
+    });
+    remove(path.c_str());
+}
+#endif // #ifdef RUN_BENCH
+#endif // #ifndef HISTORYLOG_CC
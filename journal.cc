@@ -0,0 +1,105 @@
+#ifndef JOURNAL_CC
+#define JOURNAL_CC
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Undo/redo of snapshots of calculator state.
+namespace NJournal {
+    // Immutable value, copies of a snapshot share one object.
+    template <typename T>
+    using TShared = std::shared_ptr<const T>;
+
+    // Linear undo/redo history of snapshots, the last committed one is
+    // the current state. Committing after an undo drops the redo branch.
+    // With capacity != 0 the oldest snapshots are forgotten.
+    template <typename TSnapshot>
+    class TJournal {
+    public:
+        explicit TJournal(size_t capacity = 0)
+            : capacity(capacity) {
+        }
+
+        void Commit(TSnapshot s) {
+            redo.clear();
+            undo.push_back(std::move(s));
+            if (capacity != 0 && undo.size() > capacity) {
+                undo.pop_front();
+            }
+        }
+        // The snapshot to restore, NULL when there is nothing to undo.
+        const TSnapshot* Undo() {
+            if (undo.size() < 2) {
+                return NULL;
+            }
+            redo.push_back(std::move(undo.back()));
+            undo.pop_back();
+            return &undo.back();
+        }
+        const TSnapshot* Redo() {
+            if (redo.empty()) {
+                return NULL;
+            }
+            undo.push_back(std::move(redo.back()));
+            redo.pop_back();
+            return &undo.back();
+        }
+        const TSnapshot* Current() const {
+            return undo.empty() ? NULL : &undo.back();
+        }
+
+        size_t GetUndoDepth() const {
+            return undo.empty() ? 0 : undo.size() - 1;
+        }
+        size_t GetRedoDepth() const {
+            return redo.size();
+        }
+        void Clear() {
+            undo.clear();
+            redo.clear();
+        }
+
+    private:
+        size_t capacity;
+        std::deque<TSnapshot> undo;
+        std::vector<TSnapshot> redo;
+    };
+} // namespace NJournal
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+
+void test_journal() {
+    using namespace NJournal;
+
+    TEST_CASE("Undo/Redo");
+    {
+        TJournal<int> j;
+        TEST_CHECK(j.Current() == NULL && j.Undo() == NULL && j.Redo() == NULL);
+        j.Commit(1);
+        j.Commit(2);
+        j.Commit(3);
+        TEST_CHECK(*j.Current() == 3 && j.GetUndoDepth() == 2);
+        TEST_CHECK(*j.Undo() == 2);
+        TEST_CHECK(*j.Undo() == 1);
+        TEST_CHECK(j.Undo() == NULL && *j.Current() == 1);
+        TEST_CHECK(*j.Redo() == 2 && j.GetRedoDepth() == 1);
+        j.Commit(4);
+        TEST_CHECK(j.Redo() == NULL && j.GetRedoDepth() == 0);
+        TEST_CHECK(*j.Undo() == 2);
+        j.Clear();
+        TEST_CHECK(j.Current() == NULL);
+    }
+    TEST_CASE("Capacity");
+    {
+        TJournal<int> j(3);
+        for (int i = 0; i < 10; i++) {
+            j.Commit(i);
+        }
+        TEST_CHECK(j.GetUndoDepth() == 2);
+        TEST_CHECK(*j.Undo() == 8 && *j.Undo() == 7 && j.Undo() == NULL);
+    }
+}
+#endif // #ifdef RUN_TESTS
+#endif // #ifndef JOURNAL_CC
@@ -0,0 +1,218 @@
+#ifndef LRU_CC
+#define LRU_CC
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace NLru {
+    // Bounded map that forgets the least recently used entry; Get() and
+    // Put() are O(1). Entries live in one vector, linked into the recency
+    // list by index and found through an open addressing table of those
+    // indices, so a full cache allocates nothing but the copy of a key.
+    template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+    class TLruCache {
+    public:
+        explicit TLruCache(size_t capacity)
+            : capacity(capacity) {
+            if (capacity == 0 || capacity >= NIL / 2) {
+                throw std::invalid_argument("LRU capacity: " + std::to_string(capacity));
+            }
+            size_t size = 1;
+            while (size < capacity * 2) {
+                size *= 2;
+            }
+            entries.reserve(capacity);
+            slots.assign(size, NIL);
+        }
+
+        // NULL on a miss, a hit makes the entry the most recent one. The
+        // key may be of any type THash takes and TKey compares equal to,
+        // so a lookup need not build a TKey.
+        template <typename TQuery = TKey>
+        TValue* Get(const TQuery& key) {
+            uint32_t i = slots[Find(key, hasher(key))];
+            if (i == NIL) {
+                misses++;
+                return NULL;
+            }
+            hits++;
+            MoveToFront(i);
+            return &entries[i].value;
+        }
+
+        // Inserts or replaces the value of key, as the most recent entry.
+        TValue& Put(TKey key, TValue value) {
+            size_t hash = hasher(key);
+            size_t slot = Find(key, hash);
+            uint32_t i = slots[slot];
+            if (i != NIL) {
+                MoveToFront(i);
+                entries[i].value = std::move(value);
+                return entries[i].value;
+            }
+            if (entries.size() < capacity) {
+                i = entries.size();
+                entries.push_back({std::move(key), std::move(value), hash, NIL, NIL});
+            } else {
+                i = tail;
+                Unlink(i);
+                Erase(Find(entries[i].key, entries[i].hash));
+                slot = Find(key, hash); // the erase may have moved it
+                entries[i].key = std::move(key);
+                entries[i].value = std::move(value);
+                entries[i].hash = hash;
+            }
+            slots[slot] = i;
+            Link(i);
+            return entries[i].value;
+        }
+
+        size_t Size() const {
+            return entries.size();
+        }
+        size_t GetCapacity() const {
+            return capacity;
+        }
+        uint64_t GetHits() const {
+            return hits;
+        }
+        uint64_t GetMisses() const {
+            return misses;
+        }
+        void Clear() {
+            entries.clear();
+            std::fill(slots.begin(), slots.end(), NIL);
+            head = tail = NIL;
+        }
+
+    private:
+        static constexpr uint32_t NIL = UINT32_MAX;
+
+        struct TEntry {
+            TKey key;
+            TValue value;
+            size_t hash;
+            uint32_t prev;
+            uint32_t next;
+        };
+
+        // Slot of key, or the empty slot that ends its probe sequence.
+        template <typename TQuery>
+        size_t Find(const TQuery& key, size_t hash) const {
+            size_t mask = slots.size() - 1;
+            size_t s = hash & mask;
+            while (slots[s] != NIL && (entries[slots[s]].hash != hash || !(entries[slots[s]].key == key))) {
+                s = (s + 1) & mask;
+            }
+            return s;
+        }
+        // Empties slot s and shifts back the entries probed past it.
+        void Erase(size_t s) {
+            size_t mask = slots.size() - 1;
+            for (size_t t = (s + 1) & mask; slots[t] != NIL; t = (t + 1) & mask) {
+                size_t home = entries[slots[t]].hash & mask;
+                if (((t - home) & mask) >= ((t - s) & mask)) {
+                    slots[s] = slots[t];
+                    s = t;
+                }
+            }
+            slots[s] = NIL;
+        }
+
+        void Link(uint32_t i) {
+            entries[i].prev = NIL;
+            entries[i].next = head;
+            if (head != NIL) {
+                entries[head].prev = i;
+            }
+            head = i;
+            if (tail == NIL) {
+                tail = i;
+            }
+        }
+        void Unlink(uint32_t i) {
+            TEntry& e = entries[i];
+            (e.prev == NIL ? head : entries[e.prev].next) = e.next;
+            (e.next == NIL ? tail : entries[e.next].prev) = e.prev;
+        }
+        void MoveToFront(uint32_t i) {
+            if (head != i) {
+                Unlink(i);
+                Link(i);
+            }
+        }
+
+        size_t capacity;
+        THash hasher;
+        std::vector<TEntry> entries;
+        // indices into entries, NIL when empty
+        std::vector<uint32_t> slots;
+        // most and least recently used
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+} // namespace NLru
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+#include <string>
+
+void test_lru() {
+    using NLru::TLruCache;
+
+    TEST_CASE("Get and Put");
+    {
+        TLruCache<std::string, int> c(2);
+        TEST_CHECK(c.Get("a") == NULL);
+        c.Put("a", 1);
+        c.Put("b", 2);
+        TEST_CHECK(*c.Get("a") == 1 && c.Size() == 2);
+        c.Put("c", 3); // evicts b, a was used after it
+        TEST_CHECK(c.Get("b") == NULL && *c.Get("a") == 1 && *c.Get("c") == 3);
+        c.Put("a", 10);
+        c.Put("d", 4); // evicts c
+        TEST_CHECK(c.Get("c") == NULL && *c.Get("a") == 10 && *c.Get("d") == 4);
+        TEST_CHECK(c.GetHits() == 5 && c.GetMisses() == 3);
+        c.Clear();
+        TEST_CHECK(c.Size() == 0 && c.Get("a") == NULL);
+        c.Put("e", 5);
+        TEST_CHECK(*c.Get("e") == 5);
+    }
+    TEST_CASE("Recency order");
+    {
+        TLruCache<int, int> c(3);
+        for (int i = 0; i < 5; i++) {
+            c.Put(i, i);
+        }
+        TEST_CHECK(c.Get(0) == NULL && c.Get(1) == NULL && c.Size() == 3);
+        c.Get(2);
+        c.Put(5, 5); // evicts 3, 2 was used after it
+        TEST_CHECK(c.Get(3) == NULL);
+        TEST_CHECK(*c.Get(2) == 2 && *c.Get(4) == 4 && *c.Get(5) == 5);
+    }
+    TEST_CASE("Colliding keys");
+    {
+        struct TBadHash {
+            size_t operator()(int k) const {
+                return k % 2;
+            }
+        };
+        TLruCache<int, int, TBadHash> c(8);
+        bool found = true;
+        for (int i = 0; i < 200; i++) {
+            c.Put(i, -i);
+            for (int k = std::max(0, i - 7); k <= i; k++) {
+                found = found && c.Get(k) != NULL && *c.Get(k) == -k;
+            }
+        }
+        TEST_CHECK(found && c.Size() == 8 && c.Get(191) == NULL);
+    }
+    TEST_EXCEPTION((TLruCache<int, int>(0)), std::invalid_argument);
+}
+#endif // #ifdef RUN_TESTS
+#endif // #ifndef LRU_CC
@@ -0,0 +1,163 @@
+#ifndef NUMBER_CC
+#define NUMBER_CC
+
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Compile time requirements shared by the generic calculator parts
+// (TBasicProc, TBasicMemory): TPNumber, TFrac and TComplex satisfy them.
+namespace NNumber {
+    template <typename R, typename T>
+    using TReturns = std::enable_if_t<std::is_convertible<R, T>::value>;
+
+    // Copyable, + - * / ! Sqr() == and ToString().
+    template <typename T, typename = void>
+    struct TIsNumber : std::false_type {};
+
+    template <typename T>
+    struct TIsNumber<T, std::void_t<
+                            TReturns<decltype(std::declval<const T&>() + std::declval<const T&>()), T>,
+                            TReturns<decltype(std::declval<const T&>() - std::declval<const T&>()), T>,
+                            TReturns<decltype(std::declval<const T&>() * std::declval<const T&>()), T>,
+                            TReturns<decltype(std::declval<const T&>() / std::declval<const T&>()), T>,
+                            TReturns<decltype(!std::declval<const T&>()), T>,
+                            TReturns<decltype(std::declval<const T&>().Sqr()), T>,
+                            TReturns<decltype(std::declval<const T&>() == std::declval<const T&>()), bool>,
+                            TReturns<decltype(std::declval<const T&>().ToString()), std::string>>>
+        : std::is_copy_assignable<T> {};
+
+    // Optional in-place += -= *= /=, used instead of a temporary when present.
+    template <typename T, typename = void>
+    struct THasCompound : std::false_type {};
+
+    template <typename T>
+    struct THasCompound<T, std::void_t<
+                               decltype(std::declval<T&>() += std::declval<const T&>()),
+                               decltype(std::declval<T&>() -= std::declval<const T&>()),
+                               decltype(std::declval<T&>() *= std::declval<const T&>()),
+                               decltype(std::declval<T&>() /= std::declval<const T&>())>>
+        : std::true_type {};
+
+    // Optional x.IsZero(), the divisor test of TBasicProc.
+    template <typename T, typename = void>
+    struct THasIsZero : std::false_type {};
+
+    template <typename T>
+    struct THasIsZero<T, std::void_t<TReturns<decltype(std::declval<const T&>().IsZero()), bool>>>
+        : std::true_type {};
+
+    // x is zero: x.IsZero() when present, otherwise x == x - x.
+    template <typename T>
+    inline bool IsZero(const T& x) {
+        if constexpr (THasIsZero<T>::value) {
+            return x.IsZero();
+        } else {
+            return x == x - x;
+        }
+    }
+
+    template <typename T>
+    inline void AddTo(T& lhs, const T& rhs) {
+        if constexpr (THasCompound<T>::value) {
+            lhs += rhs;
+        } else {
+            lhs = lhs + rhs;
+        }
+    }
+
+    template <typename T>
+    inline void SubFrom(T& lhs, const T& rhs) {
+        if constexpr (THasCompound<T>::value) {
+            lhs -= rhs;
+        } else {
+            lhs = lhs - rhs;
+        }
+    }
+
+    template <typename T>
+    inline void MulBy(T& lhs, const T& rhs) {
+        if constexpr (THasCompound<T>::value) {
+            lhs *= rhs;
+        } else {
+            lhs = lhs * rhs;
+        }
+    }
+
+    template <typename T>
+    inline void DivBy(T& lhs, const T& rhs) {
+        if constexpr (THasCompound<T>::value) {
+            lhs /= rhs;
+        } else {
+            lhs = lhs / rhs;
+        }
+    }
+
+    // Result of the noexcept Try* operations of TPNumber, TBasicProc and TBasicMemory.
+    enum struct TStatus : uint8_t { Ok,
+                                    DivisionByZero,
+                                    UnsupportedOperation,
+                                    UnsupportedFunction,
+                                    OperationFailed,
+                                    FunctionFailed };
+
+    // A status and the operation it came from. Recording never allocates,
+    // the message is formatted only when ToString() is called.
+    class TError {
+    public:
+        void Set(TStatus s, const char* op = "") noexcept {
+            status = s;
+            name = op;
+            detail[0] = '\0';
+        }
+        void Set(TStatus s, const char* op, const std::exception& e) noexcept {
+            Set(s, op);
+            const char* what = e.what();
+            if (what != NULL) {
+                strncpy(detail, what, sizeof(detail) - 1);
+                detail[sizeof(detail) - 1] = '\0';
+            }
+        }
+        void Clear() noexcept {
+            Set(TStatus::Ok);
+        }
+        TStatus GetStatus() const noexcept {
+            return status;
+        }
+        bool IsOk() const noexcept {
+            return status == TStatus::Ok;
+        }
+
+        std::string ToString() const {
+            switch (status) {
+                case TStatus::Ok:
+                    return "";
+                case TStatus::DivisionByZero:
+                    return "Division by zero";
+                case TStatus::UnsupportedOperation:
+                    return "Unsupported operation: '" + std::string(name) + "'";
+                case TStatus::UnsupportedFunction:
+                    return "'" + std::string(name) + "' - function not suppoerted";
+                case TStatus::OperationFailed:
+                    return "Operation '" + std::string(name) + "' threw exception" + Detail();
+                case TStatus::FunctionFailed:
+                    return "Function '" + std::string(name) + "' threw exception" + Detail();
+            }
+            return "Unknown status " + std::to_string((int)status);
+        }
+
+    private:
+        std::string Detail() const {
+            return detail[0] ? " " + std::string(detail) : "";
+        }
+
+        TStatus status = TStatus::Ok;
+        const char* name = "";
+        char detail[128] = "";
+    };
+} // namespace NNumber
+
+#endif // #ifndef NUMBER_CC
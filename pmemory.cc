@@ -2,41 +2,74 @@
 #define PMEMORY_CC
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "number.cc"
 #include "pnumber.cc"
 
 namespace NMemory {
     using TPNumber = NPNumber::TPNumber;
 
-    class TMemory {
+    // Calculator memory for any number type satisfying NNumber::TIsNumber.
+    template <typename T>
+    class TBasicMemory {
+        static_assert(NNumber::TIsNumber<T>::value,
+                      "TBasicMemory requires copyable T with + - * / ! Sqr() == ToString()");
+
     public:
-        TMemory(int radix = 10, int precision = 0)
-            : number(TPNumber(0, radix, precision)) {
+        explicit TBasicMemory(const T& zero)
+            : number(zero) {
         }
 
-        void Store(const TPNumber p) {
+        void Store(const T p) {
             number = p;
             state = true;
         }
-        TPNumber Get() {
+        T Get() {
             return number;
         }
         std::string GetAsStr() const {
             return number.ToString();
         }
 
-        void Add(const TPNumber& p) {
-            number += p;
+        void Add(const T& p) {
+            NNumber::AddTo(number, p);
             state = true;
         }
-        void Clear(int radix, int precision) {
-            number = TPNumber(0, radix, precision);
+        // Store / Add that report a failure instead of throwing; the
+        // register is left unchanged then and the error is set.
+        NNumber::TStatus TryStore(const T& p) noexcept {
+            return Try("MS", [&] {
+                number = p;
+            });
+        }
+        NNumber::TStatus TryAdd(const T& p) noexcept {
+            return Try("M+", [&] {
+                T sum = number;
+                NNumber::AddTo(sum, p);
+                number = std::move(sum);
+            });
+        }
+        std::string GetError() const {
+            return error.ToString();
+        }
+        NNumber::TStatus GetStatus() const noexcept {
+            return error.GetStatus();
+        }
+
+        void Clear(const T& zero) {
+            number = zero;
             state = false;
+            error.Clear();
         }
         bool GetState() {
             return state;
@@ -45,14 +78,187 @@ namespace NMemory {
             return state ? "_On" : "_Off";
         }
 
+        struct TSnapshot {
+            T number;
+            bool state;
+        };
+        TSnapshot Save() const {
+            return {number, state};
+        }
+        void Restore(const TSnapshot& s) {
+            number = s.number;
+            state = s.state;
+        }
+
     private:
-        TPNumber number;
+        template <typename TBody>
+        NNumber::TStatus Try(const char* op, TBody&& body) noexcept {
+            using NNumber::TStatus;
+            try {
+                body();
+                state = true;
+                error.Clear();
+            } catch (const std::exception& e) {
+                error.Set(TStatus::OperationFailed, op, e);
+            } catch (...) {
+                error.Set(TStatus::OperationFailed, op);
+            }
+            return error.GetStatus();
+        }
+
+        T number;
         bool state = false;
+        NNumber::TError error;
+    };
+
+    class TMemory : public TBasicMemory<TPNumber> {
+    public:
+        TMemory(int radix = 10, int precision = 0)
+            : TBasicMemory(TPNumber(0, radix, precision)) {
+        }
+
+        using TBasicMemory::Clear;
+        void Clear(int radix, int precision) {
+            Clear(TPNumber(0, radix, precision));
+        }
+    };
+
+    class invalid_register : public std::invalid_argument {
+    public:
+        explicit invalid_register(const std::string& message)
+            : std::invalid_argument(message) {
+        }
+    };
+
+    // Size of the slot each register of TMemoryBank owns.
+    static const size_t MEMORY_CACHE_LINE = 64;
+
+    // N memory registers shared between threads without a mutex.
+    // Radix and precision are common to the bank. A register keeps the
+    // full long double as TMemory does, in two atomic words behind a
+    // sequence lock: readers retry while a writer holds it, writers take
+    // it with a compare-and-swap. Every register sits on its own cache
+    // line.
+    class TMemoryBank {
+        static_assert(sizeof(long double) <= 2 * sizeof(uint64_t), "long double must fit two words");
+
+    public:
+        explicit TMemoryBank(size_t size, int radix = 10, int precision = 0)
+            : size(size)
+            , zero(0, radix, precision)
+            , registers(new TRegister[size]) {
+        }
+
+        size_t Size() const {
+            return size;
+        }
+
+        void Store(size_t i, const TPNumber& p) {
+            TRegister& r = At(i);
+            Update(r, [&p](long double) {
+                return p.GetNumber();
+            });
+            r.state.store(true, std::memory_order_release);
+        }
+        TPNumber Get(size_t i) const {
+            TPNumber result = zero;
+            result.SetNumber(Load(At(i)));
+            return result;
+        }
+        std::string GetAsStr(size_t i) const {
+            return Get(i).ToString();
+        }
+
+        void Add(size_t i, const TPNumber& p) {
+            TRegister& r = At(i);
+            long double delta = p.GetNumber();
+            Update(r, [delta](long double current) {
+                return current + delta;
+            });
+            r.state.store(true, std::memory_order_release);
+        }
+        void Clear(size_t i) {
+            TRegister& r = At(i);
+            Update(r, [](long double) {
+                return 0.0L;
+            });
+            r.state.store(false, std::memory_order_release);
+        }
+        bool GetState(size_t i) const {
+            return At(i).state.load(std::memory_order_acquire);
+        }
+        std::string GetStateAsStr(size_t i) const {
+            return GetState(i) ? "_On" : "_Off";
+        }
+
+    private:
+        struct alignas(MEMORY_CACHE_LINE) TRegister {
+            // odd while a writer holds the register
+            std::atomic<uint64_t> sequence{0};
+            // bytes of the long double value
+            std::atomic<uint64_t> words[2] = {};
+            std::atomic<bool> state{false};
+        };
+
+        static long double Load(const TRegister& r) {
+            uint64_t words[2];
+            while (true) {
+                uint64_t s = r.sequence.load(std::memory_order_acquire);
+                if (s & 1) {
+                    std::this_thread::yield(); // the writer may be descheduled
+                    continue;
+                }
+                words[0] = r.words[0].load(std::memory_order_relaxed);
+                words[1] = r.words[1].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (r.sequence.load(std::memory_order_relaxed) == s) {
+                    break;
+                }
+            }
+            long double v;
+            memcpy(&v, words, sizeof(v));
+            return v;
+        }
+        // Replaces the value v with f(v) while holding the register.
+        template <typename F>
+        static void Update(TRegister& r, F&& f) {
+            uint64_t s = r.sequence.load(std::memory_order_relaxed);
+            while ((s & 1) || !r.sequence.compare_exchange_weak(s, s + 1, std::memory_order_acquire,
+                                                                std::memory_order_relaxed)) {
+                if (s & 1) {
+                    std::this_thread::yield();
+                    s = r.sequence.load(std::memory_order_relaxed);
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            uint64_t words[2] = {r.words[0].load(std::memory_order_relaxed),
+                                 r.words[1].load(std::memory_order_relaxed)};
+            long double v;
+            memcpy(&v, words, sizeof(v));
+            v = f(v);
+            memcpy(words, &v, sizeof(v));
+            r.words[0].store(words[0], std::memory_order_relaxed);
+            r.words[1].store(words[1], std::memory_order_relaxed);
+            r.sequence.store(s + 2, std::memory_order_release);
+        }
+
+        TRegister& At(size_t i) const {
+            if (i >= size) {
+                throw invalid_register("Register " + std::to_string(i) + " out of " + std::to_string(size));
+            }
+            return registers[i];
+        }
+
+        size_t size;
+        TPNumber zero;
+        std::unique_ptr<TRegister[]> registers;
     };
 }; // namespace NMemory
 
 #ifdef RUN_TESTS
 #include "acutest.h"
+#include "complex.cc"
+#include "fractional.cc"
 using namespace std;
 
 void test_pmemory_constructor() {
@@ -140,5 +346,201 @@ void test_pmemory_operations() {
     }
 }
 
+void test_pmemory_generic() {
+    using namespace NMemory;
+    TEST_CASE("TBasicMemory<TFrac>");
+    {
+        TBasicMemory<NFrac::TFrac> m(NFrac::TFrac(0, 1));
+        TEST_CHECK(m.GetStateAsStr() == "_Off");
+        m.Add(NFrac::TFrac(1, 3));
+        m.Add(NFrac::TFrac(1, 6));
+        TEST_CHECK(m.GetState() && m.Get() == NFrac::TFrac(1, 2));
+        TEST_CHECK(m.GetAsStr() == "1/2");
+        m.Clear(NFrac::TFrac(0, 1));
+        TEST_CHECK(!m.GetState() && m.GetAsStr() == "0/1");
+    }
+    TEST_CASE("TBasicMemory<TComplex>");
+    {
+        TBasicMemory<NComplex::TComplex> m(NComplex::TComplex(0.0, 0.0));
+        m.Store(NComplex::TComplex(1.0, -1.0));
+        m.Add(NComplex::TComplex(0.5, 3.0));
+        TEST_CHECK(m.GetStateAsStr() == "_On");
+        TEST_CHECK(m.Get() == NComplex::TComplex(1.5, 2.0));
+    }
+    TEST_CASE("TryStore / TryAdd");
+    {
+        using NNumber::TStatus;
+        // + throws past 100
+        struct TSmall {
+            int v;
+            TSmall operator+(const TSmall& r) const {
+                if (v + r.v > 100) {
+                    throw std::overflow_error("past 100");
+                }
+                return {v + r.v};
+            }
+            TSmall operator-(const TSmall& r) const {
+                return {v - r.v};
+            }
+            TSmall operator*(const TSmall& r) const {
+                return {v * r.v};
+            }
+            TSmall operator/(const TSmall& r) const {
+                return {v / r.v};
+            }
+            TSmall operator!() const {
+                return {-v};
+            }
+            TSmall Sqr() const {
+                return {v * v};
+            }
+            bool operator==(const TSmall& r) const {
+                return v == r.v;
+            }
+            std::string ToString() const {
+                return std::to_string(v);
+            }
+        };
+        TBasicMemory<TSmall> m(TSmall{0});
+        TEST_CHECK(m.TryAdd(TSmall{60}) == TStatus::Ok && m.GetState() && m.Get().v == 60);
+        TEST_CHECK(m.TryAdd(TSmall{60}) == TStatus::OperationFailed && m.Get().v == 60);
+        TEST_CHECK(m.GetError() == "Operation 'M+' threw exception past 100");
+        TEST_CHECK(m.TryStore(TSmall{7}) == TStatus::Ok && m.GetStatus() == TStatus::Ok && m.Get().v == 7);
+        TEST_CHECK(m.TryAdd(TSmall{100}) == TStatus::OperationFailed);
+        m.Clear(TSmall{0});
+        TEST_CHECK(!m.GetState() && m.GetStatus() == TStatus::Ok);
+
+        TMemory p(10, 1);
+        TEST_CHECK(p.TryAdd(TPNumber(2.5, 10, 1)) == TStatus::Ok && p.GetAsStr() == "2.5");
+    }
+}
+
+void test_pmemory_bank() {
+    using namespace NMemory;
+    using TPNumber = NPNumber::TPNumber;
+
+    TEST_CASE("TMemoryBank");
+    {
+        TMemoryBank b(3, 16, 2);
+        TEST_CHECK(b.Size() == 3);
+        TEST_CHECK(b.GetStateAsStr(1) == "_Off" && b.GetAsStr(1) == "0.00");
+        b.Store(1, TPNumber(10.5, 10, 0));
+        TEST_CHECK(b.GetState(1) && b.GetAsStr(1) == "A.80");
+        TEST_CHECK(b.Get(1).GetRadix() == 16 && b.Get(1).GetPrecision() == 2);
+        b.Add(1, TPNumber(5.5, 2, 0));
+        TEST_CHECK(b.Get(1).GetNumber() == 16);
+        b.Add(2, TPNumber(1, 10, 0));
+        TEST_CHECK(b.GetState(2) && !b.GetState(0));
+        b.Clear(1);
+        TEST_CHECK(!b.GetState(1) && b.Get(1).GetNumber() == 0);
+        TEST_EXCEPTION(b.Get(3), invalid_register);
+        TEST_EXCEPTION(b.Add(3, TPNumber(1, 10, 0)), invalid_register);
+        TEST_EXCEPTION(TMemoryBank(1, 1, 0), NPNumber::invalid_radix);
+    }
+    TEST_CASE("Full precision");
+    {
+        TMemoryBank b(1, 16, 0);
+        const long double max = 0x1p64L - 1; // does not fit a double
+        TMemory m(16, 0);
+        m.Store(TPNumber(max, 16, 0));
+        b.Store(0, TPNumber(max, 16, 0));
+        TEST_CHECK(b.Get(0).GetNumber() == max && b.GetAsStr(0) == m.GetAsStr());
+        TEST_CHECK_(b.GetAsStr(0) == "FFFFFFFFFFFFFFFF", "%s", b.GetAsStr(0).c_str());
+        b.Add(0, TPNumber(-max + 1, 10, 0));
+        TEST_CHECK(b.Get(0).GetNumber() == 1);
+    }
+    TEST_CASE("Reads are not torn");
+    {
+        TMemoryBank b(1);
+        const long double values[] = {0x1p64L - 1, -0x1p-70L};
+        std::atomic<bool> stop{false};
+        std::thread writer([&] {
+            for (int i = 0; !stop.load(); i++) {
+                b.Store(0, TPNumber(values[i & 1], 10, 0));
+            }
+        });
+        bool whole = true;
+        for (int i = 0; i < 100000 && whole; i++) {
+            long double v = b.Get(0).GetNumber();
+            whole = v == 0 || v == values[0] || v == values[1];
+        }
+        stop = true;
+        writer.join();
+        TEST_CHECK(whole);
+    }
+    TEST_CASE("Concurrent Add");
+    {
+        TMemoryBank b(2);
+        const int threads = 8;
+        const int adds = 10000;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&b, t] {
+                for (int i = 0; i < adds; i++) {
+                    b.Add(0, TPNumber(1, 10, 0));
+                    b.Add(1, TPNumber(t, 10, 0));
+                }
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        TEST_CHECK(b.Get(0).GetNumber() == threads * adds);
+        TEST_CHECK(b.Get(1).GetNumber() == adds * threads * (threads - 1) / 2);
+    }
+}
 #endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include <mutex>
+
+// Adds from 1 to 64 threads to one shared register, to a register per
+// thread and to a mutex guarded TMemory.
+void bench_pmemory_bank() {
+    using namespace NMemory;
+    const size_t adds = 100000;
+    const TPNumber one(1, 10, 0);
+    auto run = [](size_t threads, auto&& body) {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back(body, t);
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    };
+    for (size_t threads : {1, 2, 4, 8, 16, 32, 64}) {
+        char title[96];
+        TMemoryBank bank(threads);
+        snprintf(title, sizeof(title), "TMemoryBank shared register, threads %zu", threads);
+        NBench::Measure(title, 1, [&] {
+            run(threads, [&](size_t) {
+                for (size_t i = 0; i < adds; i++) {
+                    bank.Add(0, one);
+                }
+            });
+        });
+        snprintf(title, sizeof(title), "TMemoryBank register per thread, threads %zu", threads);
+        NBench::Measure(title, 1, [&] {
+            run(threads, [&](size_t t) {
+                for (size_t i = 0; i < adds; i++) {
+                    bank.Add(t, one);
+                }
+            });
+        });
+        TMemory memory;
+        std::mutex lock;
+        snprintf(title, sizeof(title), "TMemory with mutex, threads %zu", threads);
+        NBench::Measure(title, 1, [&] {
+            run(threads, [&](size_t) {
+                for (size_t i = 0; i < adds; i++) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    memory.Add(one);
+                }
+            });
+        });
+    }
+}
+#endif // #ifdef RUN_BENCH
 #endif // #ifndef PMEMORY_CC
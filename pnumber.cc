@@ -12,9 +12,12 @@
 #include <vector>
 
 #include "const.cc"
+#include "number.cc"
+#include "stats.cc"
 
 namespace NPNumber {
     using NConst::DOUBLE_PRECISION;
+    using NNumber::TStatus;
     using NConst::RADIX_MAX;
     using NConst::RADIX_MIN;
 
@@ -74,51 +77,79 @@ namespace NPNumber {
             out << p.ToString();
             return out;
         }
-        TPNumber operator+(const TPNumber& rhs) const {
-            return {number + rhs.number, radix, precision};
+        TPNumber operator+(const TPNumber& rhs) const noexcept {
+            return TPNumber(number + rhs.number, radix, precision, Unchecked());
         }
-        void operator+=(const TPNumber& rhs) {
+        void operator+=(const TPNumber& rhs) noexcept {
             number += rhs.number;
         }
-        TPNumber operator-(const TPNumber& rhs) const {
-            return {number - rhs.number, radix, precision};
+        TPNumber operator-(const TPNumber& rhs) const noexcept {
+            return TPNumber(number - rhs.number, radix, precision, Unchecked());
         }
-        void operator-=(const TPNumber& rhs) {
+        void operator-=(const TPNumber& rhs) noexcept {
             number -= rhs.number;
         }
-        TPNumber operator*(const TPNumber& rhs) const {
-            return {number * rhs.number, radix, precision};
+        TPNumber operator*(const TPNumber& rhs) const noexcept {
+            return TPNumber(number * rhs.number, radix, precision, Unchecked());
         }
-        void operator*=(const TPNumber& rhs) {
+        void operator*=(const TPNumber& rhs) noexcept {
             number *= rhs.number;
         }
         TPNumber operator/(const TPNumber& rhs) const {
-            if (rhs.number == 0) {
+            TPNumber result;
+            if (TryDiv(rhs, result) != TStatus::Ok) {
                 throw division_by_zero(Repr() + "/" + rhs.Repr());
             }
-            return {number / rhs.number, radix, precision};
+            return result;
         }
         void operator/=(const TPNumber& rhs) {
-            if (rhs.number == 0) {
+            if (TryDivBy(rhs) != TStatus::Ok) {
                 throw division_by_zero(Repr() + "/" + rhs.Repr());
             }
-            number /= rhs.number;
         }
-        bool operator==(const TPNumber& rhs) const {
+        bool operator==(const TPNumber& rhs) const noexcept {
             return number == rhs.number;
         }
-        bool operator!=(const TPNumber& rhs) const {
+        bool operator!=(const TPNumber& rhs) const noexcept {
             return number != rhs.number;
         }
+        bool IsZero() const noexcept {
+            return number == 0;
+        }
         TPNumber operator!() const {
-            if (number == 0) {
+            TPNumber result;
+            if (TryRevert(result) != TStatus::Ok) {
                 throw division_by_zero("1/" + Repr());
             }
-            return {1 / number, radix, precision};
+            return result;
+        }
+
+        // Exception free counterparts of / /= and !, a zero divisor is
+        // reported as TStatus::DivisionByZero and leaves the target unchanged.
+        TStatus TryDiv(const TPNumber& rhs, TPNumber& result) const noexcept {
+            if (rhs.number == 0) {
+                return TStatus::DivisionByZero;
+            }
+            result = TPNumber(number / rhs.number, radix, precision, Unchecked());
+            return TStatus::Ok;
+        }
+        TStatus TryDivBy(const TPNumber& rhs) noexcept {
+            if (rhs.number == 0) {
+                return TStatus::DivisionByZero;
+            }
+            number /= rhs.number;
+            return TStatus::Ok;
+        }
+        TStatus TryRevert(TPNumber& result) const noexcept {
+            if (number == 0) {
+                return TStatus::DivisionByZero;
+            }
+            result = TPNumber(1 / number, radix, precision, Unchecked());
+            return TStatus::Ok;
         }
 
-        TPNumber Sqr() const {
-            return {number * number, radix, precision};
+        TPNumber Sqr() const noexcept {
+            return TPNumber(number * number, radix, precision, Unchecked());
         }
 
         long double GetNumber() const {
@@ -138,6 +169,7 @@ namespace NPNumber {
         }
 
         std::string ToString() const {
+            STATS_SCOPE("TPNumber::ToString");
             long double outNumber = number;
             if (radix == 10 && !_doCarry) {
                 outNumber = Truncate(number, precision);
@@ -153,29 +185,69 @@ namespace NPNumber {
 
             long double positive_number = std::abs(outNumber);
 
-            long tmpN = (long)positive_number;
-            long double fdouble = (positive_number - (long double)tmpN);
+            long double integer = std::floor(positive_number);
+            long double fdouble = positive_number - integer;
             std::string fs = fractionToString(fdouble);
             if (_doCarry) {
                 // probably valid only for positive numbers, skip by default
-                int carry = doFractionCarry(fs);
-                tmpN += carry;
+                integer += doFractionCarry(fs);
             }
-            do {
-                result += NConst::ALPHABET[tmpN % radix];
-                tmpN /= radix;
-            } while (tmpN);
-            std::reverse(result.begin(), result.end());
-
             if (outNumber < 0) {
-                result = "-" + result;
+                result += NConst::MINUS;
             }
+            AppendInteger(result, integer, radix);
             if (precision > 0) {
                 fs.resize(precision, '0');
                 result += "." + fs;
             }
             return result;
         }
+        // ToString() in every radix from RADIX_MIN to RADIX_MAX, indexed by
+        // radix - RADIX_MIN. The integer part and the decimal digits of the
+        // fraction are taken once; the fraction digits of radices 2/4/8 are
+        // the leading bits of the radix 16 ones and radix 3 reuses radix 9.
+        std::vector<std::string> ToStringAllRadices() const {
+            STATS_SCOPE("TPNumber::ToStringAllRadices");
+            std::vector<std::string> result(RADIX_MAX - RADIX_MIN + 1);
+            long double decimal = Truncate(number, precision);
+            if (_doCarry || !IsPlain(number) || !IsPlain(decimal)) {
+                TPNumber n(*this);
+                for (int r = RADIX_MIN; r <= RADIX_MAX; r++) {
+                    n.radix = r;
+                    result[r - RADIX_MIN] = n.ToString();
+                }
+                return result;
+            }
+            TParts parts(number);
+            TParts parts10 = decimal == number ? parts : TParts(decimal);
+            uint64_t fraction[RADIX_MAX + 1];
+            fraction[16] = parts.Scaled(16);
+            for (int bits = 1; bits < 4; bits++) {
+                fraction[1 << bits] = fraction[16] >> (DOUBLE_PRECISION * (4 - bits));
+            }
+            fraction[9] = parts.Scaled(9);
+            fraction[3] = fraction[9] / Power(3, DOUBLE_PRECISION);
+            for (int r : {5, 6, 7, 11, 12, 13, 14, 15}) {
+                fraction[r] = parts.Scaled(r);
+            }
+            fraction[10] = parts10.Scaled(10);
+
+            for (int r = RADIX_MIN; r <= RADIX_MAX; r++) {
+                const TParts& p = r == 10 ? parts10 : parts;
+                std::string& out = result[r - RADIX_MIN];
+                out.reserve(80 + precision);
+                if (p.negative) {
+                    out += NConst::MINUS;
+                }
+                AppendDigits(out, p.integer, r, 1);
+                if (precision > 0) {
+                    out += NConst::DOT;
+                    AppendDigits(out, fraction[r], r, DOUBLE_PRECISION);
+                    out.resize(out.size() - DOUBLE_PRECISION + precision, NConst::ZERO);
+                }
+            }
+            return result;
+        }
         std::string Repr() const {
             std::stringstream sresult;
             sresult << "TPNumber("
@@ -205,6 +277,9 @@ namespace NPNumber {
         void SetDoCarry(bool v = true) {
             _doCarry = v;
         }
+        bool GetDoCarry() const {
+            return _doCarry;
+        }
 
         static long double ParseNumber(const std::string& number_, int base) {
             if (number_.empty()) {
@@ -277,6 +352,9 @@ namespace NPNumber {
         }
 
         static long double Truncate(long double x, long n) {
+            if (!(std::fabs(x) < 0x1p64L)) {
+                return x; // no fraction digits, and x * 10^n may overflow
+            }
             if (x > 0) {
                 x = floor(x * pow(10, n)) / pow(10, n);
             } else if (x < 0) {
@@ -286,9 +364,103 @@ namespace NPNumber {
         }
 
     private:
+        struct Unchecked {};
+        // radix and precision are already validated, used by the arithmetic
+        TPNumber(long double n, int b, int c, Unchecked) noexcept
+            : number(n)
+            , radix(b)
+            , precision(c) {
+        }
+
+        // Finite and below 2^63, the range ToString() renders itself.
+        static bool IsPlain(long double v) {
+            return std::isfinite(v) && std::fabs(v) < 0x1p63L;
+        }
+
+        static uint64_t Power(uint64_t r, size_t n) {
+            uint64_t power = 1;
+            while (n--) {
+                power *= r;
+            }
+            return power;
+        }
+
+        // |value| split as ToString() does: the integer part and the
+        // fraction as 15 decimal digits, printed once for all radices.
+        struct TParts {
+            explicit TParts(long double value)
+                : negative(value < 0) {
+                long double positive = std::abs(value);
+                integer = (uint64_t)positive;
+                char fstring[DOUBLE_PRECISION + 3]; // "0." and '\0'
+                snprintf(fstring, sizeof(fstring), "%.15Lf", positive - (long double)integer);
+                fraction = strtoull(fstring + 2 /*skip 0.*/, NULL, 10);
+            }
+            // The 15 fraction digits in radix r as an integer, the same
+            // digits fractionToString() finds one at a time.
+            uint64_t Scaled(int r) const {
+                return (unsigned __int128)fraction * Power(r, DOUBLE_PRECISION) / Power(10, DOUBLE_PRECISION);
+            }
+
+            uint64_t integer;
+            uint64_t fraction;
+            bool negative;
+        };
+
+        // Appends the non-negative integer v in radix r. Values past 2^64
+        // are divided as a multiword integer, the mantissa shifted by the
+        // binary exponent.
+        static void AppendInteger(std::string& out, long double v, int r) {
+            if (v < 0x1p64L) {
+                AppendDigits(out, (uint64_t)v, r, 1);
+                return;
+            }
+            int exponent;
+            uint64_t mantissa = (uint64_t)std::ldexp(std::frexp(v, &exponent), 64);
+            exponent -= 64;
+            // little endian 32-bit words of mantissa << exponent
+            std::vector<uint32_t> words(exponent / 32 + 3, 0);
+            unsigned __int128 shifted = (unsigned __int128)mantissa << (exponent % 32);
+            for (size_t i = exponent / 32; shifted != 0; i++, shifted >>= 32) {
+                words[i] = (uint32_t)shifted;
+            }
+            std::string digits;
+            while (!words.empty()) {
+                uint64_t rest = 0;
+                for (size_t i = words.size(); i-- > 0;) {
+                    uint64_t cur = rest << 32 | words[i];
+                    words[i] = cur / r;
+                    rest = cur % r;
+                }
+                digits += NConst::ALPHABET[rest];
+                while (!words.empty() && words.back() == 0) {
+                    words.pop_back();
+                }
+            }
+            out.append(digits.rbegin(), digits.rend());
+        }
+
+        // Appends n in radix r, left padded with zeros to width digits.
+        static void AppendDigits(std::string& out, uint64_t n, int r, size_t width) {
+            char buffer[64];
+            char* end = buffer + sizeof(buffer);
+            char* begin = end;
+            if ((r & (r - 1)) == 0) {
+                const int bits = __builtin_ctz(r);
+                for (; n != 0 || (size_t)(end - begin) < width; n >>= bits) {
+                    *--begin = NConst::ALPHABET[n & (r - 1)];
+                }
+            } else {
+                for (; n != 0 || (size_t)(end - begin) < width; n /= r) {
+                    *--begin = NConst::ALPHABET[n % r];
+                }
+            }
+            out.append(begin, end);
+        }
+
         std::string fractionToString(long double fraction) const {
-            char fstring[DOUBLE_PRECISION + 2]; // +2 is leading 0.
-            sprintf(fstring, "%.15Lf", fraction);
+            char fstring[DOUBLE_PRECISION + 3]; // "0." and '\0'
+            snprintf(fstring, sizeof(fstring), "%.15Lf", fraction);
             std::string fs(fstring);
             std::vector<int> fracVec;
             transform(fs.begin() + 2 /*skip 0.*/, fs.end(),
@@ -657,6 +829,23 @@ void test_pnumber_operations() {
 
     TEST_CASE("Sqr");
     TEST_CHECK(TPNumber("-4", "10", "3").Sqr().GetNumber() == 16);
+
+    TEST_CASE("TryDiv, TryDivBy, TryRevert");
+    {
+        using NNumber::TStatus;
+        TPNumber r(7, 16, 2);
+        TEST_CHECK(TPNumber(1, 2, 3).TryDiv(TPNumber(4, 2, 2), r) == TStatus::Ok);
+        TEST_CHECK(r.GetNumber() == 0.25 && r.GetRadix() == 2 && r.GetPrecision() == 3);
+        TEST_CHECK(TPNumber(1, 2, 3).TryDiv(TPNumber(0, 2, 2), r) == TStatus::DivisionByZero);
+        TEST_CHECK(r.GetNumber() == 0.25); // unchanged
+        TEST_CHECK(TPNumber(0, 10, 0).TryRevert(r) == TStatus::DivisionByZero);
+        TEST_CHECK(TPNumber(-4, 10, 0).TryRevert(r) == TStatus::Ok && r.GetNumber() == -0.25);
+        TPNumber a(6, 10, 1);
+        TEST_CHECK(a.TryDivBy(TPNumber(0, 10, 1)) == TStatus::DivisionByZero && a.GetNumber() == 6);
+        TEST_CHECK(a.TryDivBy(TPNumber(3, 10, 1)) == TStatus::Ok && a.GetNumber() == 2);
+        TEST_EXCEPTION(a /= TPNumber(0, 10, 1), division_by_zero);
+        TEST_EXCEPTION(!TPNumber(0, 10, 1), division_by_zero);
+    }
 }
 
 void test_pnumber_fraction_carry() {
@@ -718,5 +907,48 @@ void test_pnumber_fraction_carry() {
     }
 }
 
+void test_pnumber_large() {
+    using namespace NPNumber;
+    TEST_CHECK(TPNumber(0x1p63L, 10, 0).ToString() == "9223372036854775808");
+    TEST_CHECK(TPNumber(-0x1p80L, 16, 2).ToString() == "-100000000000000000000.00");
+    TEST_CHECK(TPNumber(0x1p100L, 10, 0).ToString() == "1267650600228229401496703205376");
+    TEST_CHECK(TPNumber(0x1p74L - 0x1p10L, 16, 0).ToString() == "3FFFFFFFFFFFFFFFC00");
+    TEST_CHECK(TPNumber(0x1p70L * 3, 3, 0).ToString().size() == 46); // 3^45 < 3 * 2^70 < 3^46
+    std::string huge = TPNumber(0x1p16000L, 2, 1).ToString();
+    TEST_CHECK(huge.size() == 16003 && huge.substr(0, 3) == "100" && huge.substr(16000) == "0.0");
+}
+
+void test_pnumber_all_radices() {
+    using namespace NPNumber;
+    std::vector<long double> values = {
+        0, -0.0L, 0.5, -1, 255.9375, 1 / 3.0L, -2 / 7.0L, 0.999999999999999999L,
+        1e-20L, 123456.789L, -98765.4321L, 1e18L, 0x1p62L + 3, 1e30L,
+        INFINITY, -INFINITY, NAN};
+    srand(42);
+    for (int i = 0; i < 200; i++) {
+        values.push_back((rand() - RAND_MAX / 2) / (long double)(rand() % 1000 + 1));
+    }
+    TEST_CASE("Same as ToString");
+    for (long double v : values) {
+        for (int precision : {0, 1, 3, 15, 20}) {
+            TPNumber p(v, 10, precision);
+            std::vector<std::string> all = p.ToStringAllRadices();
+            for (int r = RADIX_MIN; r <= RADIX_MAX; r++) {
+                p.SetRadix(r);
+                std::string e = p.ToString();
+                if (!TEST_CHECK(all[r - RADIX_MIN] == e)) {
+                    TEST_MSG("%s: %s != %s", p.Repr().c_str(), all[r - RADIX_MIN].c_str(), e.c_str());
+                }
+            }
+        }
+    }
+    TEST_CASE("With carry");
+    {
+        TPNumber p(0.99999, 10, 3);
+        p.SetDoCarry();
+        TEST_CHECK(p.ToStringAllRadices()[16 - RADIX_MIN] == "1.000");
+    }
+}
+
 #endif // #ifdef RUN_TESTS
 #endif // #ifndef PNUMBER_CC
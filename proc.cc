@@ -3,8 +3,10 @@
 #include <exception>
 #include <sstream>
 
+#include "number.cc"
 #include "pmemory.cc"
 #include "pnumber.cc"
+#include "stats.cc"
 
 namespace NProc {
     using TPNumber = NPNumber::TPNumber;
@@ -17,115 +19,189 @@ namespace NProc {
     enum struct TFunction { Revert,
                             Sqr };
 
-    class TProc {
+    // Calculator processor for any number type satisfying NNumber::TIsNumber,
+    // operations are resolved at compile time (no virtual calls).
+    template <typename T>
+    class TBasicProc {
+        static_assert(NNumber::TIsNumber<T>::value,
+                      "TBasicProc requires copyable T with + - * / ! Sqr() == ToString()");
+
     public:
-        TProc(int r = 10, int p = 0) {
-            Reset(r, p);
+        explicit TBasicProc(const T& zero)
+            : leftOpAndResult(zero)
+            , rightOp(zero) {
         }
 
-        void Reset(int r, int p) {
-            leftOpAndResult = TPNumber(0, r, p);
-            rightOp = TPNumber(0, r, p);
+        void Reset(const T& z) {
+            leftOpAndResult = z;
+            rightOp = z;
             operation = TOperation::None;
-            error.clear();
+            error.Clear();
         }
-        TPNumber GetLeftOpRes() const {
+        T GetLeftOpRes() const {
             return leftOpAndResult;
         }
-        void SetLeftOp(TPNumber p) {
+        void SetLeftOp(T p) {
             leftOpAndResult = p;
         }
-        TPNumber GetRightOp() const {
+        T GetRightOp() const {
             return rightOp;
         }
-        void SetRightOp(TPNumber p) {
+        void SetRightOp(T p) {
             rightOp = p;
         }
         void FunctionRun(TFunction kind) {
-            std::string fn = "Unknown";
+            TryFunctionRun(kind);
+        }
+        NNumber::TStatus TryFunctionRun(TFunction kind) noexcept {
+            STATS_SCOPE("TProc::FunctionRun");
+            return TryApply(kind, rightOp, error);
+        }
+        TOperation GetOperation() const {
+            return operation;
+        }
+        void SetOperation(TOperation o) {
+            operation = o;
+        }
+        void OperationClear() {
+            operation = TOperation::None;
+        }
+        void OperationRun() {
+            TryOperationRun();
+        }
+        NNumber::TStatus TryOperationRun() noexcept {
+            STATS_SCOPE("TProc::OperationRun");
+            return TryApply(operation, leftOpAndResult, rightOp, error);
+        }
+
+        // x = kind(x), the semantics of FunctionRun for callers that keep
+        // their own operands. On failure x is left unchanged and error is set.
+        static NNumber::TStatus TryApply(TFunction kind, T& x, NNumber::TError& error) noexcept {
+            using NNumber::TStatus;
+            const char* fn = "Unknown";
             try {
                 switch (kind) {
                     case TFunction::Revert:
                         fn = "Revert(!)";
-                        rightOp = !rightOp;
-                        break;
+                        if (NNumber::IsZero(x)) {
+                            error.Set(TStatus::DivisionByZero, fn);
+                            return TStatus::DivisionByZero;
+                        }
+                        x = !x;
+                        return TStatus::Ok;
                     case TFunction::Sqr:
                         fn = "Sqr";
-                        rightOp = rightOp.Sqr();
-                        break;
+                        x = x.Sqr();
+                        return TStatus::Ok;
                     default:
-                        error = "'" + fn + "' - function not suppoerted";
+                        error.Set(TStatus::UnsupportedFunction, fn);
                 }
             } catch (const NPNumber::division_by_zero&) {
-                error = "Division by zero";
+                error.Set(TStatus::DivisionByZero, fn);
             } catch (const std::exception& e) {
-                error = "Function '" + fn + "' threw exception";
-                if (e.what() != NULL) {
-                    error += " ";
-                    error += e.what();
-                }
+                error.Set(TStatus::FunctionFailed, fn, e);
+            } catch (...) {
+                error.Set(TStatus::FunctionFailed, fn);
             }
+            return error.GetStatus();
         }
-        TOperation GetOperation() const {
-            return operation;
-        }
-        void SetOperation(TOperation o) {
-            operation = o;
-        }
-        void OperationClear() {
-            operation = TOperation::None;
-        }
-        void OperationRun() {
-            std::string op = "None";
+
+        // lhs = lhs op rhs, the semantics of OperationRun. On failure lhs
+        // is left unchanged and error is set.
+        static NNumber::TStatus TryApply(TOperation operation, T& lhs, const T& rhs, NNumber::TError& error) noexcept {
+            using NNumber::TStatus;
+            const char* op = "None";
             try {
                 switch (operation) {
                     case TOperation::None:
-                        break;
+                        return TStatus::Ok;
                     case TOperation::Add:
                         op = "+";
-                        leftOpAndResult += rightOp;
-                        break;
+                        NNumber::AddTo(lhs, rhs);
+                        return TStatus::Ok;
                     case TOperation::Sub:
                         op = "-";
-                        leftOpAndResult -= rightOp;
-                        break;
+                        NNumber::SubFrom(lhs, rhs);
+                        return TStatus::Ok;
                     case TOperation::Mul:
                         op = "*";
-                        leftOpAndResult *= rightOp;
-                        break;
+                        NNumber::MulBy(lhs, rhs);
+                        return TStatus::Ok;
                     case TOperation::Div:
                         op = "/";
-                        leftOpAndResult /= rightOp;
-                        break;
+                        if (NNumber::IsZero(rhs)) {
+                            error.Set(TStatus::DivisionByZero, op);
+                            return TStatus::DivisionByZero;
+                        }
+                        NNumber::DivBy(lhs, rhs);
+                        return TStatus::Ok;
                     default:
-                        error = "Unsupported operation: '" + op + "'";
+                        error.Set(TStatus::UnsupportedOperation, op);
                 }
             } catch (const NPNumber::division_by_zero&) {
-                error = "Division by zero";
+                error.Set(TStatus::DivisionByZero, op);
             } catch (const std::exception& e) {
-                error = "Operation '" + op + "' threw exception";
-                if (e.what() != NULL) {
-                    error += " ";
-                    error += e.what();
-                }
+                error.Set(TStatus::OperationFailed, op, e);
+            } catch (...) {
+                error.Set(TStatus::OperationFailed, op);
             }
+            return error.GetStatus();
         }
+
+        // Operands and operation, what undo brings back. The error is not
+        // part of it, Restore() clears it.
+        struct TSnapshot {
+            T leftOpAndResult;
+            T rightOp;
+            TOperation operation;
+        };
+        TSnapshot Save() const {
+            return {leftOpAndResult, rightOp, operation};
+        }
+        void Restore(const TSnapshot& s) {
+            leftOpAndResult = s.leftOpAndResult;
+            rightOp = s.rightOp;
+            operation = s.operation;
+            error.Clear();
+        }
+
+        // The message is built here, failing runs only record a status.
         std::string GetError() const {
-            return error;
+            return error.ToString();
+        }
+        NNumber::TStatus GetStatus() const noexcept {
+            return error.GetStatus();
         }
-        void ClearError() {
-            error = "";
+        void ClearError() noexcept {
+            error.Clear();
         }
 
     private:
-        TPNumber leftOpAndResult;
-        TPNumber rightOp;
+        T leftOpAndResult;
+        T rightOp;
         TOperation operation = TOperation::None;
-        std::string error = "";
+        NNumber::TError error;
+    };
+
+    class TProc : public TBasicProc<TPNumber> {
+    public:
+        TProc(int r = 10, int p = 0)
+            : TBasicProc(TPNumber(0, r, p)) {
+        }
+
+        using TBasicProc::Reset;
+        void Reset(int r, int p) {
+            Reset(TPNumber(0, r, p));
+        }
     };
 }; // namespace NProc
 
 #ifdef RUN_TESTS
+#include "acutest.h"
+#include "complex.cc"
+#include "fractional.cc"
+#include <complex>
+
 void test_proc_construction() {
     using namespace NProc;
     using TPNumber = NPNumber::TPNumber;
@@ -275,5 +351,211 @@ void test_proc_operations() {
     }
 }
 
+void test_proc_status() {
+    using namespace NProc;
+    using NNumber::TStatus;
+    using TPNumber = NPNumber::TPNumber;
+
+    TEST_CASE("TryOperationRun");
+    {
+        TProc p(10, 2);
+        p.SetLeftOp(TPNumber(6, 10, 2));
+        p.SetRightOp(TPNumber(3, 10, 2));
+        p.SetOperation(TOperation::Div);
+        TEST_CHECK(p.TryOperationRun() == TStatus::Ok);
+        TEST_CHECK(p.GetLeftOpRes().GetNumber() == 2 && p.GetStatus() == TStatus::Ok);
+        p.SetRightOp(TPNumber(0, 10, 2));
+        TEST_CHECK(p.TryOperationRun() == TStatus::DivisionByZero);
+        TEST_CHECK(p.GetLeftOpRes().GetNumber() == 2); // unchanged
+        TEST_CHECK(p.GetStatus() == TStatus::DivisionByZero);
+        TEST_CHECK(p.GetError() == "Division by zero");
+        p.SetOperation((TOperation)42);
+        TEST_CHECK(p.TryOperationRun() == TStatus::UnsupportedOperation);
+        TEST_CHECK(p.GetError() == "Unsupported operation: 'None'");
+        p.ClearError();
+        TEST_CHECK(p.GetStatus() == TStatus::Ok && p.GetError() == "");
+    }
+    TEST_CASE("TryFunctionRun");
+    {
+        TProc p(10, 2);
+        p.SetRightOp(TPNumber(0, 10, 2));
+        TEST_CHECK(p.TryFunctionRun(TFunction::Revert) == TStatus::DivisionByZero);
+        TEST_CHECK(p.TryFunctionRun((TFunction)42) == TStatus::UnsupportedFunction);
+        TEST_CHECK(p.GetError() == "'Unknown' - function not suppoerted");
+        p.Reset(5, 1);
+        TEST_CHECK(p.GetStatus() == TStatus::Ok);
+    }
+    TEST_CASE("TError");
+    {
+        NNumber::TError e;
+        TEST_CHECK(e.IsOk() && e.ToString() == "");
+        e.Set(TStatus::OperationFailed, "*", std::runtime_error("overflow"));
+        TEST_CHECK(e.ToString() == "Operation '*' threw exception overflow");
+        e.Set(TStatus::FunctionFailed, "Sqr");
+        TEST_CHECK(e.ToString() == "Function 'Sqr' threw exception");
+    }
+}
+
+void test_proc_generic() {
+    using namespace NProc;
+    using NComplex::TComplex;
+    using NFrac::TFrac;
+
+    TEST_CASE("Number requirements");
+    {
+        static_assert(NNumber::TIsNumber<TPNumber>::value, "TPNumber");
+        static_assert(NNumber::TIsNumber<TFrac>::value, "TFrac");
+        static_assert(NNumber::TIsNumber<TComplex>::value, "TComplex");
+        static_assert(!NNumber::TIsNumber<int>::value, "int has no Sqr()");
+        static_assert(!NNumber::TIsNumber<std::string>::value, "string has no arithmetic");
+        TEST_CHECK(NNumber::THasCompound<TPNumber>::value);
+        TEST_CHECK(!NNumber::THasCompound<TFrac>::value);
+    }
+    TEST_CASE("TBasicProc<TFrac>");
+    {
+        TBasicProc<TFrac> p(TFrac(0, 1));
+        p.SetLeftOp(TFrac(1, 2));
+        p.SetRightOp(TFrac(1, 3));
+        p.SetOperation(TOperation::Add);
+        p.OperationRun();
+        TEST_CHECK(p.GetLeftOpRes() == TFrac(5, 6));
+        p.SetOperation(TOperation::Div);
+        p.OperationRun();
+        TEST_CHECK(p.GetLeftOpRes() == TFrac(5, 2));
+        p.FunctionRun(TFunction::Sqr);
+        TEST_CHECK(p.GetRightOp() == TFrac(1, 9));
+        p.FunctionRun(TFunction::Revert);
+        TEST_CHECK(p.GetRightOp() == TFrac(9, 1));
+        TEST_CHECK(p.GetError() == "");
+
+        p.SetRightOp(TFrac(0, 1));
+        p.OperationRun();
+        TEST_CHECK(p.GetError() == "Division by zero");
+        TEST_CHECK(p.GetLeftOpRes() == TFrac(5, 2)); // unchanged
+        p.ClearError();
+        p.FunctionRun(TFunction::Revert);
+        TEST_CHECK(p.GetError() == "Division by zero");
+        p.Reset(TFrac(0, 1));
+        TEST_CHECK(p.GetError() == "" && p.GetOperation() == TOperation::None);
+
+        // the reset value is not the divisor checked for zero
+        TBasicProc<TFrac> one(TFrac(1, 1));
+        one.SetLeftOp(TFrac(1, 2));
+        one.SetOperation(TOperation::Div);
+        one.OperationRun();
+        TEST_CHECK(one.GetError() == "" && one.GetLeftOpRes() == TFrac(1, 2));
+        one.SetRightOp(TFrac(0, 3));
+        one.OperationRun();
+        TEST_CHECK(one.GetError() == "Division by zero");
+        TEST_CHECK(NNumber::IsZero(std::complex<double>(0.0, -0.0)) && !NNumber::IsZero(TComplex(0.0, 1e-300)));
+    }
+    TEST_CASE("TBasicProc<TComplex>");
+    {
+        TBasicProc<TComplex> p(TComplex(0.0, 0.0));
+        p.SetLeftOp(TComplex(1.0, 2.0));
+        p.SetRightOp(TComplex(3.0, -4.0));
+        p.SetOperation(TOperation::Mul);
+        p.OperationRun();
+        TEST_CHECK(p.GetLeftOpRes() == TComplex(11.0, 2.0));
+        p.SetOperation(TOperation::Sub);
+        p.OperationRun();
+        TEST_CHECK(p.GetLeftOpRes() == TComplex(8.0, 6.0));
+        p.FunctionRun(TFunction::Sqr);
+        TEST_CHECK(p.GetRightOp() == TComplex(-7.0, -24.0));
+        p.SetRightOp(TComplex(0.0, -0.0));
+        p.SetOperation(TOperation::Div);
+        p.OperationRun();
+        TEST_CHECK(p.GetError() == "Division by zero");
+        TEST_CHECK(p.GetLeftOpRes() == TComplex(8.0, 6.0));
+    }
+}
 #endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include "complex.cc"
+#include "fractional.cc"
+
+// Operation chain Add, Mul, Sub, Div over a small cycle of operands,
+// through the processor and through hand-written code.
+template <typename T>
+void bench_proc_chain(const char* name, const T& zero, const std::vector<T>& operands) {
+    using namespace NProc;
+    const size_t iters = 1000000;
+    const TOperation ops[] = {TOperation::Add, TOperation::Mul, TOperation::Sub, TOperation::Div};
+    char title[96];
+
+    TBasicProc<T> p(zero);
+    size_t i = 0;
+    snprintf(title, sizeof(title), "TBasicProc<%s> OperationRun", name);
+    NBench::Measure(title, iters, [&] {
+        p.SetLeftOp(operands[i % operands.size()]);
+        p.SetRightOp(operands[(i + 1) % operands.size()]);
+        p.SetOperation(ops[i & 3]);
+        p.OperationRun();
+        NBench::DoNotOptimize(p.GetLeftOpRes());
+        i++;
+    });
+    snprintf(title, sizeof(title), "hand-written %s loop", name);
+    NBench::Measure(title, iters, [&] {
+        T l = operands[i % operands.size()];
+        const T& r = operands[(i + 1) % operands.size()];
+        switch (i & 3) {
+            case 0:
+                l = l + r;
+                break;
+            case 1:
+                l = l * r;
+                break;
+            case 2:
+                l = l - r;
+                break;
+            default:
+                l = l / r;
+        }
+        NBench::DoNotOptimize(l);
+        i++;
+    });
+}
+
+// Division by a zero divisor every other step, reported by exception
+// and by status.
+void bench_proc_div_zero() {
+    using NPNumber::TPNumber;
+    const size_t iters = 200000;
+    const TPNumber divisors[] = {TPNumber(3, 16, 4), TPNumber(0, 16, 4)};
+    TPNumber x(1.5, 16, 4);
+    TPNumber r;
+    size_t i = 0;
+    NBench::Measure("TPNumber operator/ with try/catch", iters, [&] {
+        try {
+            r = x / divisors[i++ & 1];
+        } catch (const NPNumber::division_by_zero&) {
+        }
+        NBench::DoNotOptimize(r);
+    });
+    NBench::Measure("TPNumber TryDiv", iters, [&] {
+        NBench::DoNotOptimize(x.TryDiv(divisors[i++ & 1], r));
+        NBench::DoNotOptimize(r);
+    });
+    NProc::TProc p(16, 4);
+    p.SetOperation(NProc::TOperation::Div);
+    NBench::Measure("TProc TryOperationRun", iters, [&] {
+        p.SetLeftOp(x);
+        p.SetRightOp(divisors[i++ & 1]);
+        NBench::DoNotOptimize(p.TryOperationRun());
+    });
+}
+
+void bench_proc() {
+    using NComplex::TComplex;
+    using NFrac::TFrac;
+    using NPNumber::TPNumber;
+    bench_proc_chain<TPNumber>("TPNumber", TPNumber(0, 16, 4),
+                               {TPNumber(1.5, 16, 4), TPNumber(-2.25, 16, 4), TPNumber(7, 16, 4)});
+    bench_proc_chain<TFrac>("TFrac", TFrac(0, 1), {TFrac(1, 2), TFrac(-2, 3), TFrac(7, 5)});
+    bench_proc_chain<TComplex>("TComplex", TComplex(0.0, 0.0),
+                               {TComplex(1.5, 2.0), TComplex(-2.25, 0.5), TComplex(7.0, -1.0)});
+}
+#endif // #ifdef RUN_BENCH
 #endif // #ifndef PROC_CC
@@ -0,0 +1,359 @@
+#ifndef REPLAY_CC
+#define REPLAY_CC
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "control.cc"
+
+// Ui event recording and headless replay against TCtrl.
+// A recording is a text file, one event per line: "<kind>[ <argument>]",
+// empty lines and lines starting with '#' are skipped.
+namespace NReplay {
+    class invalid_event : public std::invalid_argument {
+    public:
+        explicit invalid_event(const std::string& message)
+            : std::invalid_argument(message) {
+        }
+    };
+
+    // One per Ui handler that changes the controller.
+    enum struct TKind : uint8_t {
+        Digit,       // digit button, argument is the digit
+        Dot,         // argument is the precision the Ui sets with the dot
+        Sign,
+        Backspace,
+        Clear,
+        Text,        // source text edited, argument is the new text
+        SourceRadix, // argument is the radix
+        OutputRadix,
+        Precision,
+        AddToHistory,
+        FromHistory, // argument is the history index
+    };
+    static const char* const KIND_NAMES[] = {
+        "digit", "dot", "sign", "backspace", "clear", "text",
+        "source_radix", "output_radix", "precision", "add_history", "from_history"};
+    static const size_t KINDS = sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]);
+
+    struct TEvent {
+        TKind kind;
+        std::string argument;
+
+        std::string ToString() const {
+            std::string line = KIND_NAMES[(size_t)kind];
+            return argument.empty() ? line : line + " " + argument;
+        }
+        // Integer argument of the radix, precision and history events.
+        int GetInt() const {
+            char* end;
+            long n = strtol(argument.c_str(), &end, 10);
+            if (argument.empty() || *end != '\0') {
+                throw invalid_event(ToString());
+            }
+            return n;
+        }
+
+        static TEvent Parse(const std::string& line) {
+            size_t space = line.find(' ');
+            std::string name = line.substr(0, space);
+            std::string argument = space == std::string::npos ? "" : line.substr(space + 1);
+            for (size_t k = 0; k < KINDS; k++) {
+                if (name == KIND_NAMES[k]) {
+                    TKind kind = (TKind)k;
+                    // text may be empty and the dot precision is optional,
+                    // the rest have a fixed arity
+                    if (kind != TKind::Text && kind != TKind::Dot && HasArgument(kind) == argument.empty()) {
+                        throw invalid_event(line);
+                    }
+                    return {kind, argument};
+                }
+            }
+            throw invalid_event(line);
+        }
+
+    private:
+        static bool HasArgument(TKind kind) {
+            switch (kind) {
+                case TKind::Digit:
+                case TKind::Text:
+                case TKind::SourceRadix:
+                case TKind::OutputRadix:
+                case TKind::Precision:
+                case TKind::FromHistory:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    };
+
+    std::vector<TEvent> Load(std::istream& in) {
+        std::vector<TEvent> events;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] != '#') {
+                events.push_back(TEvent::Parse(line));
+            }
+        }
+        return events;
+    }
+
+    // Appends events to a file, does nothing until Open() succeeds. Every
+    // line is flushed so that a crash keeps the events before it.
+    class TRecorder {
+    public:
+        bool Open(const std::string& path) {
+            out.open(path, std::ios::app);
+            return out.is_open();
+        }
+        bool IsOpen() const {
+            return out.is_open();
+        }
+        void Record(TKind kind, const std::string& argument = "") {
+            if (out.is_open()) {
+                out << TEvent{kind, argument}.ToString() << std::endl;
+            }
+        }
+
+    private:
+        std::ofstream out;
+    };
+
+    // Heap allocations, counted only by a binary that replaces operator
+    // new to bump it (see replay_main.cc).
+    inline std::atomic<uint64_t> allocations{0};
+
+    // What the Ui handler for the event does: the controller call, then
+    // for the events that convert, the output the Ui hands to its worker,
+    // rendered through the conversion cache as the worker does with
+    // renderer.
+    // Errors the Ui ignores (invalid digits, bad indices) are ignored.
+    void Apply(NCtrl::TCtrl& c, NCtrl::TRenderer& renderer, const TEvent& e) {
+        try {
+            switch (e.kind) {
+                case TKind::Digit:
+                    c.AddDigit(e.argument[0]);
+                    break;
+                case TKind::Dot:
+                    c.AddDot();
+                    if (!e.argument.empty()) {
+                        c.SetOutputPrecision(e.GetInt());
+                    }
+                    return;
+                case TKind::Sign:
+                    c.AddSign();
+                    break;
+                case TKind::Backspace:
+                    c.Backspace();
+                    break;
+                case TKind::Clear:
+                    c.Clear();
+                    return;
+                case TKind::Text:
+                    // converts only when the editor changed the text
+                    if (c.ReSetNumber(e.argument) == e.argument) {
+                        return;
+                    }
+                    break;
+                case TKind::SourceRadix:
+                    c.SetSourceRadix(e.GetInt());
+                    c.SetToSource();
+                    return;
+                case TKind::OutputRadix:
+                    c.SetOutputRadix(e.GetInt());
+                    break;
+                case TKind::Precision:
+                    c.SetOutputPrecision(e.GetInt());
+                    break;
+                case TKind::AddToHistory:
+                    c.AddToHistory();
+                    return;
+                case TKind::FromHistory:
+                    c.SetFromHistory(e.GetInt());
+                    break;
+            }
+        } catch (const invalid_event&) {
+            throw;
+        } catch (const std::exception&) {
+            if (e.kind == TKind::Text || e.kind == TKind::Dot) {
+                return; // the Ui does not convert after these
+            }
+            // the Ui logs it and converts anyway
+        }
+        NCtrl::TOutput output = c.GetOutput();
+        c.Render(output, renderer);
+        output.number.ToStringAllRadices();
+    }
+
+    // Latencies and allocations of the events of one kind.
+    struct TKindStats {
+        std::vector<uint64_t> ns;
+        uint64_t allocations = 0;
+        uint64_t maxAllocations = 0;
+
+        // Nearest rank, 0 when nothing was recorded.
+        uint64_t Percentile(double q) const {
+            if (ns.empty()) {
+                return 0;
+            }
+            std::vector<uint64_t> sorted(ns);
+            size_t rank = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            return sorted[rank];
+        }
+    };
+
+    // Stats per kind, the last entry is all events together, and the
+    // lookups in the parse and conversion caches of TCtrl.
+    struct TReport {
+        TKindStats kinds[KINDS + 1];
+        uint64_t cacheHits = 0;
+        uint64_t cacheMisses = 0;
+        uint64_t conversionHits = 0;
+        uint64_t conversionMisses = 0;
+
+        // One line per kind seen: count, p50/p90/p99/max ns and
+        // allocations per event (mean and max), then the cache hit rates.
+        std::string ToString() const {
+            std::ostringstream out;
+            char line[160];
+            snprintf(line, sizeof(line), "%-14s %8s %9s %9s %9s %9s %9s %9s\n",
+                     "event", "count", "p50_ns", "p90_ns", "p99_ns", "max_ns", "allocs", "max_alloc");
+            out << line;
+            for (size_t k = 0; k <= KINDS; k++) {
+                const TKindStats& s = kinds[k];
+                if (s.ns.empty()) {
+                    continue;
+                }
+                snprintf(line, sizeof(line), "%-14s %8zu %9llu %9llu %9llu %9llu %9.1f %9llu\n",
+                         k == KINDS ? "all" : KIND_NAMES[k], s.ns.size(),
+                         (unsigned long long)s.Percentile(0.5), (unsigned long long)s.Percentile(0.9),
+                         (unsigned long long)s.Percentile(0.99), (unsigned long long)s.Percentile(1.0),
+                         (double)s.allocations / s.ns.size(), (unsigned long long)s.maxAllocations);
+                out << line;
+            }
+            if (cacheHits + cacheMisses > 0) {
+                snprintf(line, sizeof(line), "parse cache: %llu hits, %llu misses, %.1f%% hit rate\n",
+                         (unsigned long long)cacheHits, (unsigned long long)cacheMisses,
+                         100.0 * cacheHits / (cacheHits + cacheMisses));
+                out << line;
+            }
+            if (conversionHits + conversionMisses > 0) {
+                snprintf(line, sizeof(line), "conversion cache: %llu hits, %llu misses, %.1f%% hit rate\n",
+                         (unsigned long long)conversionHits, (unsigned long long)conversionMisses,
+                         100.0 * conversionHits / (conversionHits + conversionMisses));
+                out << line;
+            }
+            return out.str();
+        }
+    };
+
+    // Applies the events to c, adding the time and allocations of each
+    // one to report. The worker renderer lives as long as the replay.
+    void Replay(NCtrl::TCtrl& c, const std::vector<TEvent>& events, TReport& report) {
+        NCtrl::TRenderer renderer;
+        uint64_t hits = c.GetCacheHits();
+        uint64_t misses = c.GetCacheMisses();
+        uint64_t conversionHits = c.GetConversionHits();
+        uint64_t conversionMisses = c.GetConversionMisses();
+        for (const TEvent& e : events) {
+            uint64_t allocated = allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            Apply(c, renderer, e);
+            auto stop = std::chrono::steady_clock::now();
+            allocated = allocations.load(std::memory_order_relaxed) - allocated;
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+            for (TKindStats* s : {&report.kinds[(size_t)e.kind], &report.kinds[KINDS]}) {
+                s->ns.push_back(ns);
+                s->allocations += allocated;
+                s->maxAllocations = std::max(s->maxAllocations, allocated);
+            }
+        }
+        report.cacheHits += c.GetCacheHits() - hits;
+        report.cacheMisses += c.GetCacheMisses() - misses;
+        report.conversionHits += c.GetConversionHits() - conversionHits;
+        report.conversionMisses += c.GetConversionMisses() - conversionMisses;
+    }
+} // namespace NReplay
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+#include <cstdio>
+#include <unistd.h>
+
+void test_replay() {
+    using namespace NReplay;
+
+    TEST_CASE("Parse");
+    {
+        TEST_CHECK(TEvent::Parse("digit F").kind == TKind::Digit);
+        TEST_CHECK(TEvent::Parse("source_radix 16").GetInt() == 16);
+        TEST_CHECK(TEvent::Parse("text").argument.empty());
+        TEST_CHECK(TEvent::Parse("text -1.5").ToString() == "text -1.5");
+        TEST_EXCEPTION(TEvent::Parse("digit"), invalid_event);
+        TEST_CHECK(TEvent::Parse("dot").argument.empty() && TEvent::Parse("dot 3").GetInt() == 3);
+        TEST_EXCEPTION(TEvent::Parse("sign 1"), invalid_event);
+        TEST_EXCEPTION(TEvent::Parse("press 1"), invalid_event);
+        TEST_EXCEPTION(TEvent::Parse("precision x").GetInt(), invalid_event);
+    }
+    TEST_CASE("Dot sets the precision");
+    {
+        NCtrl::TCtrl c;
+        NCtrl::TRenderer renderer;
+        Apply(c, renderer, TEvent::Parse("digit 1"));
+        Apply(c, renderer, TEvent::Parse("dot 2"));
+        Apply(c, renderer, TEvent::Parse("dot 5")); // the second dot fails, precision stays
+        TEST_CHECK(c.GetOutputPrecision() == 2 && c.GetSourceNumberAsStr() == "1.");
+    }
+    TEST_CASE("Record and replay");
+    {
+        std::string path = "/tmp/test_replay." + std::to_string(getpid()) + ".events";
+        {
+            TRecorder r;
+            TEST_CHECK(!r.IsOpen());
+            r.Record(TKind::Dot);
+            TEST_CHECK(r.Open(path));
+            r.Record(TKind::SourceRadix, "16");
+            r.Record(TKind::OutputRadix, "2");
+            for (char d : std::string("1F")) {
+                r.Record(TKind::Digit, std::string(1, d));
+            }
+            r.Record(TKind::Digit, "Z");
+            r.Record(TKind::AddToHistory);
+            r.Record(TKind::Backspace);
+            r.Record(TKind::FromHistory, "0");
+        }
+        std::ifstream in(path);
+        std::vector<TEvent> events = Load(in);
+        remove(path.c_str());
+        TEST_CHECK(events.size() == 8);
+
+        TReport report;
+        for (int round = 0; round < 2; round++) {
+            NCtrl::TCtrl c;
+            Replay(c, events, report);
+            TEST_CHECK(c.GetSourceNumberAsStr() == "1F" && c.Convert() == "11111");
+        }
+        TEST_CHECK(report.kinds[KINDS].ns.size() == 16);
+        TEST_CHECK(report.kinds[(size_t)TKind::Digit].ns.size() == 6);
+        TEST_CHECK(report.kinds[(size_t)TKind::Sign].ns.empty());
+        std::string table = report.ToString();
+        TEST_CHECK(table.find("\ndigit ") != std::string::npos && table.find("\nsign ") == std::string::npos);
+        TEST_CHECK(report.cacheMisses > 0 && table.find("\nparse cache: ") != std::string::npos);
+        TEST_CHECK(report.conversionMisses > 0 && table.find("\nconversion cache: ") != std::string::npos);
+    }
+}
+#endif // #ifdef RUN_TESTS
+#endif // #ifndef REPLAY_CC
@@ -0,0 +1,49 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#include "replay.cc"
+
+// Every allocation of the process is counted into NReplay::allocations.
+__attribute__((noinline)) void* operator new(size_t size) {
+    NReplay::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Usage: replay <events file> [repeat], drives TCtrl with the recorded Ui
+// events and prints latency percentiles and allocations per event kind.
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <events file> [repeat]\n", argv[0]);
+        return 2;
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        fprintf(stderr, "Can't open '%s'\n", argv[1]);
+        return 1;
+    }
+    size_t repeat = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+    try {
+        std::vector<NReplay::TEvent> events = NReplay::Load(in);
+        NReplay::TReport report;
+        for (size_t round = 0; round < repeat; round++) {
+            NCtrl::TCtrl control; // every round starts from a fresh Ui
+            NReplay::Replay(control, events, report);
+        }
+        printf("%zu events x %zu\n%s", events.size(), repeat, report.ToString().c_str());
+    } catch (const NReplay::invalid_event& e) {
+        fprintf(stderr, "Invalid event '%s'\n", e.what());
+        return 1;
+    }
+    return 0;
+}
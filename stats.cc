@@ -0,0 +1,393 @@
+#ifndef STATS_CC
+#define STATS_CC
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Call counters and latency histograms per call site.
+// STATS_SCOPE(name) instruments the enclosing block when the tree is
+// built with -DCALC_STATS and expands to nothing otherwise.
+namespace NStats {
+    static const size_t STATS_MAX_SITES = 32;
+    // Histogram buckets are log-linear: STATS_SUB_BUCKETS per power of
+    // two, so a bucket is at most 1/8 (12.5%) wide.
+    static const size_t STATS_SUB_BITS = 3;
+    static const size_t STATS_SUB_BUCKETS = 1 << STATS_SUB_BITS;
+    static const size_t STATS_EXPONENTS = 40;
+    static const size_t STATS_BUCKETS = STATS_SUB_BUCKETS * STATS_EXPONENTS;
+    // Every call is counted, one call in STATS_SAMPLE_EVERY is timed.
+    static const uint64_t STATS_SAMPLE_EVERY = 256;
+
+    inline size_t BucketOf(uint64_t ns) {
+        if (ns < STATS_SUB_BUCKETS) {
+            return ns;
+        }
+        size_t exponent = 63 - __builtin_clzll(ns);
+        size_t sub = (ns >> (exponent - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1);
+        size_t bucket = (exponent - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS + sub;
+        return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+    }
+    // Smallest value counted in bucket b.
+    inline uint64_t BucketLow(size_t b) {
+        if (b < STATS_SUB_BUCKETS) {
+            return b;
+        }
+        size_t exponent = b / STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+        return (uint64_t(1) << exponent) | (uint64_t(b % STATS_SUB_BUCKETS) << (exponent - STATS_SUB_BITS));
+    }
+
+    // Written only by its thread, read by DumpJson() from any thread.
+    struct TShard {
+        std::atomic<uint64_t> calls[STATS_MAX_SITES];
+        std::atomic<uint64_t> buckets[STATS_MAX_SITES][STATS_BUCKETS];
+        // longest sampled call, exact rather than a bucket bound
+        std::atomic<uint64_t> maxNs[STATS_MAX_SITES];
+
+        void Bump(std::atomic<uint64_t>& counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    };
+
+    struct TSiteStats {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t sampled = 0;
+        uint64_t maxNs = 0;
+        std::vector<uint64_t> buckets = std::vector<uint64_t>(STATS_BUCKETS, 0);
+
+        // Lower bound of the bucket holding quantile q of the samples.
+        uint64_t Percentile(double q) const {
+            uint64_t rank = std::min<uint64_t>(q * sampled, sampled ? sampled - 1 : 0);
+            uint64_t seen = 0;
+            for (size_t b = 0; b < STATS_BUCKETS; b++) {
+                seen += buckets[b];
+                if (buckets[b] != 0 && seen > rank) {
+                    return BucketLow(b);
+                }
+            }
+            return 0;
+        }
+    };
+
+    // Site names and the shards of every thread that ever recorded.
+    // Shards outlive their threads, so nothing recorded is lost.
+    class TRegistry {
+    public:
+        static TRegistry& Instance() {
+            static TRegistry registry;
+            return registry;
+        }
+
+        // Sites with the same name share an id, STATS_MAX_SITES when full.
+        size_t Register(const char* name) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < names.size(); i++) {
+                if (strcmp(names[i], name) == 0) {
+                    return i;
+                }
+            }
+            if (names.size() == STATS_MAX_SITES) {
+                return STATS_MAX_SITES;
+            }
+            names.push_back(name);
+            return names.size() - 1;
+        }
+
+        TShard* AddShard() {
+            std::lock_guard<std::mutex> guard(lock);
+            shards.emplace_back(new TShard());
+            return shards.back().get();
+        }
+        // Folds the shard of an exiting thread into the retired one and
+        // frees it, so short-lived threads do not pile up shards.
+        void RetireShard(TShard* shard) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < names.size(); i++) {
+                Add(retired.calls[i], shard->calls[i]);
+                Max(retired.maxNs[i], shard->maxNs[i]);
+                for (size_t b = 0; b < STATS_BUCKETS; b++) {
+                    Add(retired.buckets[i][b], shard->buckets[i][b]);
+                }
+            }
+            shards.erase(std::find_if(shards.begin(), shards.end(), [shard](const auto& s) {
+                return s.get() == shard;
+            }));
+        }
+        size_t GetShards() {
+            std::lock_guard<std::mutex> guard(lock);
+            return shards.size();
+        }
+
+        // Shards merged, in registration order.
+        std::vector<TSiteStats> Collect() {
+            std::lock_guard<std::mutex> guard(lock);
+            std::vector<TSiteStats> result(names.size());
+            for (size_t i = 0; i < names.size(); i++) {
+                result[i].name = names[i];
+                auto merge = [&](const TShard& shard) {
+                    result[i].calls += shard.calls[i].load(std::memory_order_relaxed);
+                    result[i].maxNs = std::max(result[i].maxNs, shard.maxNs[i].load(std::memory_order_relaxed));
+                    for (size_t b = 0; b < STATS_BUCKETS; b++) {
+                        uint64_t n = shard.buckets[i][b].load(std::memory_order_relaxed);
+                        result[i].buckets[b] += n;
+                        result[i].sampled += n;
+                    }
+                };
+                merge(retired);
+                for (auto& shard : shards) {
+                    merge(*shard);
+                }
+            }
+            return result;
+        }
+
+        void Reset() {
+            std::lock_guard<std::mutex> guard(lock);
+            auto clear = [](TShard& shard) {
+                for (size_t i = 0; i < STATS_MAX_SITES; i++) {
+                    shard.calls[i].store(0, std::memory_order_relaxed);
+                    shard.maxNs[i].store(0, std::memory_order_relaxed);
+                    for (size_t b = 0; b < STATS_BUCKETS; b++) {
+                        shard.buckets[i][b].store(0, std::memory_order_relaxed);
+                    }
+                }
+            };
+            clear(retired);
+            for (auto& shard : shards) {
+                clear(*shard);
+            }
+        }
+
+    private:
+        TRegistry() = default;
+
+        static void Add(std::atomic<uint64_t>& to, const std::atomic<uint64_t>& from) {
+            to.store(to.load(std::memory_order_relaxed) + from.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+        }
+        static void Max(std::atomic<uint64_t>& to, const std::atomic<uint64_t>& from) {
+            to.store(std::max(to.load(std::memory_order_relaxed), from.load(std::memory_order_relaxed)),
+                     std::memory_order_relaxed);
+        }
+
+        std::mutex lock;
+        std::vector<const char*> names;
+        std::vector<std::unique_ptr<TShard>> shards;
+        // counts of the threads that exited
+        TShard retired{};
+    };
+
+    // Shard of the calling thread, created on its first record and
+    // retired when the thread exits.
+    inline TShard& LocalShard() {
+        struct TOwner {
+            TShard* shard = NULL;
+            ~TOwner() {
+                if (shard != NULL) {
+                    TRegistry::Instance().RetireShard(shard);
+                }
+            }
+        };
+        thread_local TOwner local;
+        if (__builtin_expect(local.shard == NULL, 0)) {
+            local.shard = TRegistry::Instance().AddShard();
+        }
+        return *local.shard;
+    }
+
+    struct TSite {
+        explicit TSite(const char* name)
+            : id(TRegistry::Instance().Register(name)) {
+        }
+        const size_t id;
+    };
+
+    // Counts the call and times it when it falls on the sampling period.
+    class TScope {
+    public:
+        explicit TScope(const TSite& site)
+            : id(site.id) {
+            if (id == STATS_MAX_SITES) {
+                return;
+            }
+            shard = &LocalShard();
+            uint64_t n = shard->calls[id].load(std::memory_order_relaxed);
+            shard->Bump(shard->calls[id]);
+            if (n % STATS_SAMPLE_EVERY == 0) {
+                start = std::chrono::steady_clock::now();
+                sampled = true;
+            }
+        }
+        ~TScope() {
+            if (sampled) {
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start);
+                uint64_t n = ns.count();
+                shard->Bump(shard->buckets[id][BucketOf(n)]);
+                if (n > shard->maxNs[id].load(std::memory_order_relaxed)) {
+                    shard->maxNs[id].store(n, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        size_t id;
+        TShard* shard = NULL;
+        bool sampled = false;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // {"sites": [{"name", "calls", "sampled", "p50_ns", "p90_ns", "p99_ns",
+    //   "max_ns", "buckets": [[low_ns, count], ...]}]}, empty buckets omitted.
+    inline std::string DumpJson() {
+        std::string json = "{\"sites\": [";
+        std::vector<TSiteStats> sites = TRegistry::Instance().Collect();
+        for (size_t i = 0; i < sites.size(); i++) {
+            const TSiteStats& s = sites[i];
+            json += i ? ", " : "";
+            json += "{\"name\": \"" + s.name + "\", \"calls\": " + std::to_string(s.calls) +
+                    ", \"sampled\": " + std::to_string(s.sampled) +
+                    ", \"p50_ns\": " + std::to_string(s.Percentile(0.5)) +
+                    ", \"p90_ns\": " + std::to_string(s.Percentile(0.9)) +
+                    ", \"p99_ns\": " + std::to_string(s.Percentile(0.99)) +
+                    ", \"max_ns\": " + std::to_string(s.maxNs) + ", \"buckets\": [";
+            bool first = true;
+            for (size_t b = 0; b < STATS_BUCKETS; b++) {
+                if (s.buckets[b] != 0) {
+                    json += first ? "" : ", ";
+                    json += "[" + std::to_string(BucketLow(b)) + ", " + std::to_string(s.buckets[b]) + "]";
+                    first = false;
+                }
+            }
+            json += "]}";
+        }
+        return json + "]}";
+    }
+} // namespace NStats
+
+#ifdef CALC_STATS
+#define STATS_SCOPE(name)                          \
+    static const NStats::TSite _statsSite((name)); \
+    NStats::TScope _statsScope(_statsSite)
+#else
+#define STATS_SCOPE(name)
+#endif // #ifdef CALC_STATS
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+#include <thread>
+
+void test_stats() {
+    using namespace NStats;
+
+    TEST_CASE("Buckets");
+    {
+        bool ok = true;
+        for (uint64_t v : {0ull, 1ull, 7ull, 8ull, 9ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456789ull}) {
+            size_t b = BucketOf(v);
+            ok = ok && BucketLow(b) <= v && (b + 1 == STATS_BUCKETS || v < BucketLow(b + 1));
+            ok = ok && v - BucketLow(b) <= v / STATS_SUB_BUCKETS;
+        }
+        TEST_CHECK(ok);
+        TEST_CHECK(BucketOf(uint64_t(-1)) == STATS_BUCKETS - 1);
+    }
+    TEST_CASE("Scopes merged across threads");
+    {
+        static const TSite site("test.stats");
+        TRegistry::Instance().Reset();
+        auto work = [] {
+            for (int i = 0; i < 100; i++) {
+                TScope scope(site);
+            }
+        };
+        std::thread t(work);
+        work();
+        t.join();
+        std::string json = DumpJson();
+        std::string expect = "\"name\": \"test.stats\", \"calls\": 200, \"sampled\": " +
+                             std::to_string(2 * ((100 + STATS_SAMPLE_EVERY - 1) / STATS_SAMPLE_EVERY));
+        TEST_CHECK_(json.find(expect) != std::string::npos, "%s", json.c_str());
+        TEST_CHECK(TSite("test.stats").id == site.id);
+    }
+    TEST_CASE("Percentile");
+    {
+        TSiteStats s;
+        s.buckets[BucketOf(10)] = 90;
+        s.buckets[BucketOf(1000)] = 10;
+        s.sampled = 100;
+        TEST_CHECK(s.Percentile(0.5) == BucketLow(BucketOf(10)));
+        TEST_CHECK(s.Percentile(0.95) == BucketLow(BucketOf(1000)));
+    }
+    TEST_CASE("Exact max");
+    {
+        static const TSite site("test.stats.max");
+        TRegistry::Instance().Reset();
+        {
+            TScope scope(site); // the first call is sampled
+            std::this_thread::sleep_for(std::chrono::microseconds(1500));
+        }
+        TSiteStats s = TRegistry::Instance().Collect()[site.id];
+        TEST_CHECK(s.sampled == 1 && s.maxNs >= 1500000);
+        TEST_CHECK(BucketOf(s.maxNs) == BucketOf(s.Percentile(1.0)));
+        TEST_CHECK(DumpJson().find("\"max_ns\": " + std::to_string(s.maxNs)) != std::string::npos);
+    }
+    TEST_CASE("Shards of exited threads");
+    {
+        static const TSite site("test.stats.retired");
+        TRegistry::Instance().Reset();
+        size_t before = TRegistry::Instance().GetShards();
+        for (int i = 0; i < 50; i++) {
+            std::thread([] {
+                for (int j = 0; j < 10; j++) {
+                    TScope scope(site);
+                }
+            }).join();
+        }
+        TEST_CHECK(TRegistry::Instance().GetShards() == before);
+        TSiteStats s = TRegistry::Instance().Collect()[site.id];
+        TEST_CHECK(s.calls == 500 && s.sampled == 50);
+    }
+}
+#endif // #ifdef RUN_TESTS
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include <thread>
+
+// Cost of a TScope around calls of the size of the instrumented ones,
+// independent of CALC_STATS; `make bench-stats` runs the whole suite
+// instrumented and dumps the counters to bench_main.stats.json.
+void bench_stats() {
+    using namespace NStats;
+    static const TSite site("bench.stats");
+    const size_t iters = 1000000;
+    double x = 1234.5678;
+    NBench::Measure("std::to_string(double)", iters, [&] {
+        NBench::DoNotOptimize(std::to_string(x));
+    });
+    NBench::Measure("std::to_string(double) in TScope", iters, [&] {
+        TScope scope(site);
+        NBench::DoNotOptimize(std::to_string(x));
+    });
+    NBench::Measure("empty TScope", iters, [&] {
+        TScope scope(site);
+    });
+    // a thread that records once: shard allocation plus retirement
+    NBench::Measure("thread with one TScope", 1000, [&] {
+        std::thread([] {
+            TScope scope(site);
+        }).join();
+    });
+    NBench::Measure("thread without TScope", 1000, [&] {
+        std::thread([] {}).join();
+    });
+}
+#endif // #ifdef RUN_BENCH
+#endif // #ifndef STATS_CC
@@ -6,12 +6,21 @@
 #include "pmemory.cc"
 #include "pnumber.cc"
 #include "proc.cc"
+#include "expr.cc"
+#include "column.cc"
 #include "complex.cc"
+#include "fft.cc"
 #include "fractional.cc"
 #include "converter.cc"
 #include "editor.cc"
 #include "history.cc"
+#include "historylog.cc"
 #include "control.cc"
+#include "journal.cc"
+#include "lru.cc"
+#include "stats.cc"
+#include "worker.cc"
+#include "replay.cc"
 
 // acutest provide main func
 TEST_LIST = {
@@ -22,16 +31,29 @@ TEST_LIST = {
     {"pnumber_to_string", test_pnumber_to_string},
     {"pnumber_operations", test_pnumber_operations},
     {"pnumber_fraction_carry", test_pnumber_fraction_carry},
+    {"pnumber_large", test_pnumber_large},
+    {"pnumber_all_radices", test_pnumber_all_radices},
     // TMemory
     {"pmemory_constructor", test_pmemory_constructor},
     {"pmemory_operations", test_pmemory_operations},
+    {"pmemory_generic", test_pmemory_generic},
+    {"pmemory_bank", test_pmemory_bank},
     // TProc
     {"proc_constructor_and_operands", test_proc_construction},
     {"proc_functions", test_proc_functions},
     {"proc_operations", test_proc_operations},
+    {"proc_status", test_proc_status},
+    {"proc_generic", test_proc_generic},
+    // Expressions
+    {"expr", test_expr},
+    // Columns
+    {"column", test_column},
     // Complex
     {"complex_constructor", test_complex_constructor},
     {"complex_operations", test_complex_operations},
+    {"complex_precision", test_complex_precision},
+    // FFT
+    {"fft", test_fft},
     // Fractional
     {"fractional_constructor", test_fractional_construction},
     {"fractional_operations", test_fractional_operations},
@@ -40,8 +62,27 @@ TEST_LIST = {
     {"converter_p_10_operations", TestNConverter::test_converter_p_10_operations},
     // Editor
     {"editor_operations", test_editor_operations},
+    {"editor_cursor", test_editor_cursor},
     // History
     {"history", test_history},
+    {"history_ring", test_history_ring},
+    {"history_arena", test_history_arena},
+    {"history_search", test_history_search},
+    {"history_log", test_history_log},
     // Control
     {"control", test_control_operations},
+    {"control_undo", test_control_undo},
+    {"control_typing", test_control_typing},
+    {"control_render", test_control_render},
+    {"control_cache", test_control_cache},
+    // Journal
+    {"journal", test_journal},
+    // Stats
+    {"stats", test_stats},
+    // LRU
+    {"lru", test_lru},
+    // Worker
+    {"worker", test_worker},
+    // Replay
+    {"replay", test_replay},
     {NULL, NULL}};
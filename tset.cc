@@ -1,137 +1,498 @@
-#include "acutest.h"
+#ifndef TSET_CC
+#define TSET_CC
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
 #include <iostream>
-#include <set>
-#include <string>
+#include <iterator>
 #include <sstream>
-#include <vector>
 #include <stdexcept>
-#include <initializer_list>
-
-using namespace std;
+#include <string>
+#include <vector>
 
 namespace NSet {
 
-    class TSet {
+    // Storage of TBasicSet: the elements sorted and unique in one vector.
+    // At(idx) is O(1) and Has() a binary search, Insert() and Remove()
+    // shift the tail.
+    class TSortedVector {
     public:
-        TSet() {
-            _s = set<string, less<string>>();
+        typedef std::vector<std::string>::const_iterator const_iterator;
+
+        // Takes elements that are already sorted and unique.
+        void Assign(std::vector<std::string> sorted) {
+            _s = std::move(sorted);
+        }
+        bool Insert(std::string a) {
+            auto it = std::lower_bound(_s.begin(), _s.end(), a);
+            if (it != _s.end() && *it == a) {
+                return false;
+            }
+            _s.insert(it, std::move(a));
+            return true;
+        }
+        bool Remove(const std::string& a) {
+            auto it = std::lower_bound(_s.begin(), _s.end(), a);
+            if (it == _s.end() || *it != a) {
+                return false;
+            }
+            _s.erase(it);
+            return true;
+        }
+        bool Has(const std::string& a) const {
+            return std::binary_search(_s.begin(), _s.end(), a);
+        }
+        // Number of elements less than a.
+        size_t Rank(const std::string& a) const {
+            return std::lower_bound(_s.begin(), _s.end(), a) - _s.begin();
+        }
+        const std::string& At(size_t idx) const {
+            return _s[idx];
         }
+        size_t Size() const {
+            return _s.size();
+        }
+        void Clear() {
+            _s.clear();
+        }
+        const_iterator begin() const {
+            return _s.begin();
+        }
+        const_iterator end() const {
+            return _s.end();
+        }
+
+    private:
+        std::vector<std::string> _s;
+    };
+
+    // Storage of TBasicSet: a weight balanced binary search tree whose
+    // nodes know the size of their subtree. Insert(), Remove(), Has(),
+    // At(idx) and Rank() are O(log n). Nodes live in one vector and refer
+    // to each other by index, removed ones are reused.
+    class TOrderStatisticTree {
+    public:
+        // In order, keeps the path from the root to the current node.
+        class const_iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef std::string value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const std::string* pointer;
+            typedef const std::string& reference;
+
+            const_iterator() {
+            }
+            const std::string& operator*() const {
+                return tree->nodes[path.back()].key;
+            }
+            const std::string* operator->() const {
+                return &**this;
+            }
+            const_iterator& operator++() {
+                uint32_t n = tree->nodes[path.back()].right;
+                if (n != NIL) {
+                    Descend(n);
+                    return *this;
+                }
+                // up while coming from a right child
+                uint32_t child = path.back();
+                path.pop_back();
+                while (!path.empty() && tree->nodes[path.back()].right == child) {
+                    child = path.back();
+                    path.pop_back();
+                }
+                return *this;
+            }
+            const_iterator operator++(int) {
+                const_iterator it = *this;
+                ++*this;
+                return it;
+            }
+            bool operator==(const const_iterator& o) const {
+                return path.empty() ? o.path.empty() : !o.path.empty() && path.back() == o.path.back();
+            }
+            bool operator!=(const const_iterator& o) const {
+                return !(*this == o);
+            }
+
+        private:
+            friend class TOrderStatisticTree;
+
+            explicit const_iterator(const TOrderStatisticTree* tree)
+                : tree(tree) {
+                path.reserve(64);
+                Descend(tree->root);
+            }
+            void Descend(uint32_t n) {
+                for (; n != NIL; n = tree->nodes[n].left) {
+                    path.push_back(n);
+                }
+            }
+
+            const TOrderStatisticTree* tree = NULL;
+            std::vector<uint32_t> path;
+        };
 
-        TSet(initializer_list<string> in) {
-            _s = set<string, less<string>>();
-            _s.insert(in.begin(), in.end());
+        // Takes elements that are already sorted and unique, the tree is
+        // built perfectly balanced in O(n).
+        void Assign(std::vector<std::string> sorted) {
+            Clear();
+            nodes.reserve(sorted.size());
+            root = Build(sorted, 0, sorted.size());
+        }
+        bool Insert(std::string a) {
+            bool inserted = false;
+            root = Insert(root, a, inserted);
+            return inserted;
+        }
+        bool Remove(const std::string& a) {
+            bool removed = false;
+            root = Remove(root, a, removed);
+            return removed;
+        }
+        bool Has(const std::string& a) const {
+            uint32_t n = root;
+            while (n != NIL) {
+                int c = a.compare(nodes[n].key);
+                if (c == 0) {
+                    return true;
+                }
+                n = c < 0 ? nodes[n].left : nodes[n].right;
+            }
+            return false;
+        }
+        // Number of elements less than a.
+        size_t Rank(const std::string& a) const {
+            size_t rank = 0;
+            uint32_t n = root;
+            while (n != NIL) {
+                if (nodes[n].key < a) {
+                    rank += SizeOf(nodes[n].left) + 1;
+                    n = nodes[n].right;
+                } else {
+                    n = nodes[n].left;
+                }
+            }
+            return rank;
+        }
+        const std::string& At(size_t idx) const {
+            uint32_t n = root;
+            for (;;) {
+                size_t left = SizeOf(nodes[n].left);
+                if (idx == left) {
+                    return nodes[n].key;
+                }
+                if (idx < left) {
+                    n = nodes[n].left;
+                } else {
+                    idx -= left + 1;
+                    n = nodes[n].right;
+                }
+            }
+        }
+        size_t Size() const {
+            return SizeOf(root);
+        }
+        void Clear() {
+            nodes.clear();
+            root = free = NIL;
+        }
+        const_iterator begin() const {
+            return const_iterator(this);
+        }
+        const_iterator end() const {
+            return const_iterator();
         }
 
-        void Insert(string a) {
-            _s.insert(a);
+    private:
+        static constexpr uint32_t NIL = UINT32_MAX;
+        // Hirai and Yamamoto's parameters: a subtree is at most DELTA
+        // times as heavy as its sibling, a rotation is double when the
+        // inner grandchild is GAMMA times as heavy as the outer one.
+        static const size_t DELTA = 3;
+        static const size_t GAMMA = 2;
+
+        struct TNode {
+            std::string key;
+            uint32_t left;
+            uint32_t right;
+            uint32_t size;
+        };
+
+        size_t SizeOf(uint32_t n) const {
+            return n == NIL ? 0 : nodes[n].size;
+        }
+        uint32_t NewNode(std::string key) {
+            uint32_t n = free;
+            if (n != NIL) {
+                free = nodes[n].left;
+                nodes[n] = {std::move(key), NIL, NIL, 1};
+            } else {
+                n = nodes.size();
+                nodes.push_back({std::move(key), NIL, NIL, 1});
+            }
+            return n;
+        }
+        void FreeNode(uint32_t n) {
+            nodes[n].key = std::string();
+            nodes[n].left = free;
+            free = n;
+        }
+        void Update(uint32_t n) {
+            nodes[n].size = SizeOf(nodes[n].left) + SizeOf(nodes[n].right) + 1;
         }
 
-        void Remove(string a) {
-            _s.erase(a);
+        uint32_t Build(std::vector<std::string>& sorted, size_t from, size_t to) {
+            if (from == to) {
+                return NIL;
+            }
+            size_t middle = from + (to - from) / 2;
+            uint32_t left = Build(sorted, from, middle);
+            uint32_t n = NewNode(std::move(sorted[middle]));
+            nodes[n].left = left;
+            nodes[n].right = Build(sorted, middle + 1, to);
+            Update(n);
+            return n;
+        }
+
+        uint32_t RotateLeft(uint32_t n) {
+            uint32_t r = nodes[n].right;
+            nodes[n].right = nodes[r].left;
+            nodes[r].left = n;
+            Update(n);
+            Update(r);
+            return r;
+        }
+        uint32_t RotateRight(uint32_t n) {
+            uint32_t l = nodes[n].left;
+            nodes[n].left = nodes[l].right;
+            nodes[l].right = n;
+            Update(n);
+            Update(l);
+            return l;
+        }
+        // Restores the balance of n after one of its subtrees gained or
+        // lost an element.
+        uint32_t Balance(uint32_t n) {
+            uint32_t l = nodes[n].left;
+            uint32_t r = nodes[n].right;
+            size_t wl = SizeOf(l) + 1;
+            size_t wr = SizeOf(r) + 1;
+            if (wr > DELTA * wl) {
+                if (SizeOf(nodes[r].left) + 1 >= GAMMA * (SizeOf(nodes[r].right) + 1)) {
+                    nodes[n].right = RotateRight(r);
+                }
+                return RotateLeft(n);
+            }
+            if (wl > DELTA * wr) {
+                if (SizeOf(nodes[l].right) + 1 >= GAMMA * (SizeOf(nodes[l].left) + 1)) {
+                    nodes[n].left = RotateLeft(l);
+                }
+                return RotateRight(n);
+            }
+            Update(n);
+            return n;
+        }
+
+        uint32_t Insert(uint32_t n, std::string& a, bool& inserted) {
+            if (n == NIL) {
+                inserted = true;
+                return NewNode(std::move(a));
+            }
+            int c = a.compare(nodes[n].key);
+            if (c == 0) {
+                return n;
+            }
+            if (c < 0) {
+                uint32_t l = Insert(nodes[n].left, a, inserted);
+                nodes[n].left = l;
+            } else {
+                uint32_t r = Insert(nodes[n].right, a, inserted);
+                nodes[n].right = r;
+            }
+            return inserted ? Balance(n) : n;
+        }
+        // Detaches the least node of the subtree n into min.
+        uint32_t RemoveMin(uint32_t n, uint32_t& min) {
+            if (nodes[n].left == NIL) {
+                min = n;
+                return nodes[n].right;
+            }
+            uint32_t l = RemoveMin(nodes[n].left, min);
+            nodes[n].left = l;
+            return Balance(n);
+        }
+        uint32_t Remove(uint32_t n, const std::string& a, bool& removed) {
+            if (n == NIL) {
+                return NIL;
+            }
+            int c = a.compare(nodes[n].key);
+            if (c < 0) {
+                uint32_t l = Remove(nodes[n].left, a, removed);
+                nodes[n].left = l;
+            } else if (c > 0) {
+                uint32_t r = Remove(nodes[n].right, a, removed);
+                nodes[n].right = r;
+            } else {
+                removed = true;
+                uint32_t l = nodes[n].left;
+                uint32_t r = nodes[n].right;
+                FreeNode(n);
+                if (l == NIL || r == NIL) {
+                    return l == NIL ? r : l;
+                }
+                uint32_t min;
+                r = RemoveMin(r, min);
+                nodes[min].left = l;
+                nodes[min].right = r;
+                return Balance(min);
+            }
+            return removed ? Balance(n) : n;
+        }
+
+        std::vector<TNode> nodes;
+        uint32_t root = NIL;
+        // head of the removed nodes, chained by left
+        uint32_t free = NIL;
+    };
+
+    // Set of strings in order, with positional access. TStorage is
+    // TSortedVector for sets that are mostly built in bulk and read, or
+    // TOrderStatisticTree for ones that keep taking inserts and removes.
+    // The set operations merge both sides in O(n + m). To build a large
+    // set pass all the elements to the constructor, it sorts them once.
+    template <typename TStorage>
+    class TBasicSet {
+    public:
+        typedef typename TStorage::const_iterator const_iterator;
+
+        TBasicSet() {
+        }
+
+        TBasicSet(std::initializer_list<std::string> in)
+            : TBasicSet(std::vector<std::string>(in)) {
+        }
+
+        explicit TBasicSet(std::vector<std::string> in) {
+            std::sort(in.begin(), in.end());
+            in.erase(std::unique(in.begin(), in.end()), in.end());
+            _s.Assign(std::move(in));
+        }
+
+        void Insert(std::string a) {
+            _s.Insert(std::move(a));
+        }
+
+        void Remove(const std::string& a) {
+            _s.Remove(a);
         }
 
         void Clear() {
-            _s.clear();
+            _s.Clear();
         }
 
         size_t Size() const {
-            return _s.size();
+            return _s.Size();
         }
 
-        bool Has(string a) const {
-            return _s.count(a);
+        bool Has(const std::string& a) const {
+            return _s.Has(a);
+        }
+
+        // Number of elements less than a, the index of a when it is in.
+        size_t Rank(const std::string& a) const {
+            return _s.Rank(a);
         }
 
         bool Empty() const {
-            return _s.empty();
+            return _s.Size() == 0;
         }
 
-        bool operator==(const TSet& rhs) const {
-            if (Size() == rhs.Size()) {
-                for (size_t i = 0; i < Size(); i++) {
-                    string el = Get(i);
-                    if (!rhs.Has(el)) {
-                        return false;
-                    }
-                }
-                return true;
-            }
-            return false;
+        bool operator==(const TBasicSet& rhs) const {
+            return Size() == rhs.Size() && std::equal(begin(), end(), rhs.begin());
         }
 
-        bool operator!=(const TSet& rhs) const {
+        bool operator!=(const TBasicSet& rhs) const {
             return !(*this == rhs);
         }
 
-        TSet operator*(const TSet& rhs) const {
-            TSet t;
-            for (size_t i = 0; i < Size(); i++) {
-                string el = Get(i);
-                if (rhs.Has(el)) {
-                    t.Insert(el);
-                }
-            }
-            return t;
+        TBasicSet operator*(const TBasicSet& rhs) const {
+            std::vector<std::string> t;
+            t.reserve(std::min(Size(), rhs.Size()));
+            std::set_intersection(begin(), end(), rhs.begin(), rhs.end(), std::back_inserter(t));
+            return FromSorted(std::move(t));
         }
 
-        TSet operator+(TSet& rhs) const {
-            TSet t;
-            for (size_t i = 0; i < Size(); i++) {
-                t.Insert(Get(i));
-            }
-            for (size_t i = 0; i < rhs.Size(); i++) {
-                t.Insert(rhs.Get(i));
-            }
-            return t;
+        TBasicSet operator+(const TBasicSet& rhs) const {
+            std::vector<std::string> t;
+            t.reserve(Size() + rhs.Size());
+            std::set_union(begin(), end(), rhs.begin(), rhs.end(), std::back_inserter(t));
+            return FromSorted(std::move(t));
         }
 
-        TSet operator-(TSet& rhs) const {
-            TSet t;
-            for (size_t i = 0; i < Size(); i++) {
-                string el = Get(i);
-                if (!rhs.Has(el)) {
-                    t.Insert(el);
-                };
-            }
-            return t;
+        TBasicSet operator-(const TBasicSet& rhs) const {
+            std::vector<std::string> t;
+            t.reserve(Size());
+            std::set_difference(begin(), end(), rhs.begin(), rhs.end(), std::back_inserter(t));
+            return FromSorted(std::move(t));
         }
 
-        string Get(size_t idx) const {
-            if (idx < _s.size()) {
-                auto start = _s.begin();
-                for (size_t i = 0; i < idx; i++) {
-                    start++;
-                }
-                return *start;
+        const std::string& Get(size_t idx) const {
+            if (idx < _s.Size()) {
+                return _s.At(idx);
             }
-            throw out_of_range("Index " + to_string(idx));
+            throw std::out_of_range("Index " + std::to_string(idx));
         }
 
-        void Output(ostream& out = cout) const {
+        const_iterator begin() const {
+            return _s.begin();
+        }
+        const_iterator end() const {
+            return _s.end();
+        }
+
+        void Output(std::ostream& out = std::cout) const {
             out << ToString();
         }
 
-        string ToString() const {
-            stringstream out;
+        std::string ToString() const {
+            std::stringstream out;
             out << "{";
             bool first = true;
-            for (auto iter = _s.begin(); iter != _s.end(); iter++) {
+            for (const std::string& el : *this) {
                 if (!first) {
                     out << ", ";
                 } else {
                     first = false;
                 }
-                out << *iter;
+                out << el;
             }
             out << "}";
             return out.str();
         }
 
     private:
-        set<string, less<string>> _s;
-    }; // class TSet
+        static TBasicSet FromSorted(std::vector<std::string> sorted) {
+            TBasicSet t;
+            t._s.Assign(std::move(sorted));
+            return t;
+        }
+
+        TStorage _s;
+    }; // class TBasicSet
+
+    typedef TBasicSet<TSortedVector> TSet;
+    typedef TBasicSet<TOrderStatisticTree> TTreeSet;
 } // namespace NSet
 
+// Built on its own as a test, `make test TARGET=tset.cc`.
+#ifndef RUN_BENCH
+#include "acutest.h"
+
+using namespace std;
+
 void test_constructor() {
     NSet::TSet t;
     TEST_CHECK(t.Empty());
@@ -343,6 +704,73 @@ void test_to_string() {
     TEST_CHECK(o.str() == "{1, 2, a, c}");
 }
 
+void test_bulk() {
+    NSet::TSet t(vector<string>{"c", "a", "b", "a", "c"});
+    TEST_CHECK(t.ToString() == "{a, b, c}" && t.Size() == 3);
+    TEST_CHECK(t.Get(0) == "a" && t.Get(2) == "c");
+    TEST_CHECK(t == NSet::TSet({"a", "b", "c"}));
+
+    vector<string> odd, even, all;
+    for (int i = 999; i >= 0; i--) {
+        all.push_back(to_string(i));
+        (i % 2 ? odd : even).push_back(to_string(i));
+    }
+    NSet::TSet o(odd), e(even), a(all);
+    TEST_CHECK(o + e == a && a - o == e && a * e == e);
+    TEST_CHECK((o * e).Empty() && (a - a).Empty() && a + a == a);
+    for (size_t i = 1; i < a.Size(); i++) {
+        TEST_CHECK_(a.Get(i - 1) < a.Get(i), "%s < %s", a.Get(i - 1).c_str(), a.Get(i).c_str());
+    }
+}
+
+void test_rank() {
+    NSet::TSet t({"b", "d", "f"});
+    TEST_CHECK(t.Rank("a") == 0 && t.Rank("b") == 0 && t.Rank("c") == 1);
+    TEST_CHECK(t.Rank("f") == 2 && t.Rank("z") == 3);
+    NSet::TTreeSet tree({"b", "d", "f"});
+    TEST_CHECK(tree.Rank("a") == 0 && tree.Rank("d") == 1 && tree.Rank("e") == 2 && tree.Rank("z") == 3);
+    TEST_CHECK(NSet::TTreeSet().Rank("a") == 0);
+}
+
+// The tree against the vector under the same random inserts and removes.
+void test_tree() {
+    NSet::TTreeSet tree, empty;
+    NSet::TSet flat;
+    TEST_CHECK(tree.Empty() && tree.ToString() == "{}" && tree == empty);
+    TEST_EXCEPTION(tree.Get(0), out_of_range);
+
+    unsigned seed = 7;
+    bool same = true;
+    for (int i = 0; i < 20000 && same; i++) {
+        seed = seed * 1103515245 + 12345;
+        string key = to_string(seed / 65536 % 500);
+        if (seed / 16 % 3 == 0) {
+            tree.Remove(key);
+            flat.Remove(key);
+        } else {
+            tree.Insert(key);
+            flat.Insert(key);
+        }
+        size_t idx = seed / 1024 % (flat.Size() + 1);
+        same = tree.Size() == flat.Size() && tree.Has(key) == flat.Has(key) &&
+               tree.Rank(key) == flat.Rank(key) &&
+               (idx == flat.Size() || tree.Get(idx) == flat.Get(idx));
+    }
+    TEST_CHECK(same);
+    TEST_CHECK(tree.ToString() == flat.ToString());
+    TEST_CHECK(equal(tree.begin(), tree.end(), flat.begin(), flat.end()));
+
+    NSet::TTreeSet a({"1", "2", "a", "c"}), b({"a", "b", "2"});
+    TEST_CHECK(a + b == NSet::TTreeSet({"1", "2", "a", "b", "c"}));
+    TEST_CHECK(a * b == NSet::TTreeSet({"2", "a"}));
+    TEST_CHECK(a - b == NSet::TTreeSet({"1", "c"}) && (a - a).Empty());
+    TEST_CHECK(a != b && a + empty == a && a.Get(3) == "c");
+    tree.Clear();
+    TEST_CHECK(tree.Empty() && tree == empty);
+    tree.Insert("x");
+    TEST_CHECK(tree.ToString() == "{x}");
+}
+
 TEST_LIST = {
     {"constructor", test_constructor},
     {"insert", test_insert},
@@ -357,4 +785,109 @@ TEST_LIST = {
     {"substraction", test_substraction},
     {"get", test_get},
     {"to_string", test_to_string},
+    {"bulk", test_bulk},
+    {"rank", test_rank},
+    {"tree", test_tree},
     {NULL, NULL}};
+#endif // #ifndef RUN_BENCH
+
+#ifdef RUN_BENCH
+#include "bench.cc"
+#include <set>
+
+// Two sets of n numbers overlapping by half, built in bulk, then
+// merged. Strings are at most 8 characters, so they stay inline.
+void bench_tset() {
+    for (size_t n : {1000, 10000, 100000, 1000000, 10000000}) {
+        char title[96];
+        std::vector<std::string> left, right;
+        left.reserve(n);
+        right.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            // a shuffled order, 7919 is prime
+            left.push_back(std::to_string((i * 7919) % n));
+            right.push_back(std::to_string((i * 7919) % n + n / 2));
+        }
+        NSet::TSet a, b;
+        snprintf(title, sizeof(title), "TSet bulk construct, n=%zu", n);
+        NBench::Measure(title, 1, [&] {
+            a = NSet::TSet(std::move(left));
+            b = NSet::TSet(std::move(right));
+        });
+        const size_t repeat = std::max<size_t>(1, 1000000 / n);
+        snprintf(title, sizeof(title), "TSet union, n=%zu", n);
+        NBench::Measure(title, repeat, [&] {
+            NBench::DoNotOptimize((a + b).Size());
+        });
+        snprintf(title, sizeof(title), "TSet intersection, n=%zu", n);
+        NBench::Measure(title, repeat, [&] {
+            NBench::DoNotOptimize((a * b).Size());
+        });
+        snprintf(title, sizeof(title), "TSet difference, n=%zu", n);
+        NBench::Measure(title, repeat, [&] {
+            NBench::DoNotOptimize((a - b).Size());
+        });
+        NSet::TSet copy = a; // equal sets, compared to the end
+        snprintf(title, sizeof(title), "TSet equality, n=%zu", n);
+        NBench::Measure(title, repeat, [&] {
+            NBench::DoNotOptimize(a == copy);
+        });
+        size_t i = 0;
+        snprintf(title, sizeof(title), "TSet Get, n=%zu", n);
+        NBench::Measure(title, 1000000, [&] {
+            NBench::DoNotOptimize(a.Get(i++ * 7919 % n).size());
+        });
+    }
+}
+
+// A set of n keys taking an insert, a remove and a Get(idx) per step:
+// the vector, the tree and std::set with std::next to the index as
+// TSet did before. The slow ones get fewer steps at large n.
+void bench_tset_positional() {
+    auto key = [](size_t i) {
+        return std::to_string(i * 2654435761u % 4294967291u);
+    };
+    for (size_t n : {1000, 10000, 100000, 1000000}) {
+        char title[96];
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < n; i++) {
+            keys.push_back(key(i));
+        }
+        NSet::TSet flat(keys);
+        NSet::TTreeSet tree(keys);
+        std::set<std::string> linear(keys.begin(), keys.end());
+        const size_t steps = 100000;
+        const size_t slowSteps = std::max<size_t>(100, std::min(steps, 100000000 / n));
+        size_t i = 0;
+        snprintf(title, sizeof(title), "TSet (vector) insert+remove+Get, n=%zu", n);
+        NBench::Measure(title, slowSteps, [&] {
+            flat.Insert(key(n + i));
+            flat.Remove(key(i));
+            NBench::DoNotOptimize(flat.Get(i * 7919 % flat.Size()).size());
+            i++;
+        });
+        i = 0;
+        snprintf(title, sizeof(title), "TTreeSet insert+remove+Get, n=%zu", n);
+        NBench::Measure(title, steps, [&] {
+            tree.Insert(key(n + i));
+            tree.Remove(key(i));
+            NBench::DoNotOptimize(tree.Get(i * 7919 % tree.Size()).size());
+            i++;
+        });
+        i = 0;
+        snprintf(title, sizeof(title), "std::set + std::next, n=%zu", n);
+        NBench::Measure(title, slowSteps, [&] {
+            linear.insert(key(n + i));
+            linear.erase(key(i));
+            NBench::DoNotOptimize(std::next(linear.begin(), i * 7919 % linear.size())->size());
+            i++;
+        });
+        i = 0;
+        snprintf(title, sizeof(title), "TTreeSet Rank, n=%zu", n);
+        NBench::Measure(title, steps, [&] {
+            NBench::DoNotOptimize(tree.Rank(keys[i++ % n]));
+        });
+    }
+}
+#endif // #ifdef RUN_BENCH
+#endif // #ifndef TSET_CC
@@ -5,19 +5,157 @@
 #include <iostream>
 #include <wx/log.h>
 #include <wx/msgdlg.h>
+#include <wx/stdpaths.h>
 #include "wx/choicdlg.h"
+#include <wx/checkbox.h>
+#include <wx/listctrl.h>
 
 #include "converter.h"
 #include "../control.cc"
 #include "../const.cc"
+#include "../worker.cc"
+#include "../replay.cc"
+
+// Output number and the all radices view, rendered by the worker.
+struct TConverted {
+    std::string output;
+    std::vector<std::string> all;
+};
+
+// Conversion result from the worker thread, generation in ExtraLong and
+// TConverted in the payload.
+wxDEFINE_EVENT(EVT_CONVERTED, wxThreadEvent);
+
+// Virtual list over history rows: wx asks only for the rows on screen.
+class THistoryList : public wxListCtrl {
+public:
+    THistoryList(wxWindow* parent, NHistory::THistory::TView history)
+        : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxSize(420, 300),
+                     wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL | wxLC_NO_HEADER)
+        , history(history) {
+        AppendColumn(wxEmptyString, wxLIST_FORMAT_LEFT, 400);
+    }
+    // Shows the given history indices, newest last and selected.
+    void SetRows(std::vector<size_t> indices) {
+        rows.swap(indices);
+        SetItemCount(rows.size());
+        Refresh();
+        if (!rows.empty()) {
+            SetItemState(rows.size() - 1, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED,
+                         wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+            EnsureVisible(rows.size() - 1);
+        }
+    }
+    // History index of the selected row, -1 when there is none.
+    int GetSelectedIndex() const {
+        long item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+        return item < 0 ? -1 : (int)rows[item];
+    }
+    wxString OnGetItemText(long item, long WXUNUSED(column)) const override {
+        return wxString(history[rows[item]]);
+    }
+
+private:
+    NHistory::THistory::TView history;
+    std::vector<size_t> rows;
+};
+
+// Replaces wxSingleChoiceDialog, which needs every row as a string.
+// Rows are filtered by the search box as the user types.
+class THistoryDialog : public wxDialog {
+public:
+    // radix1 and radix2 are the radices the "current radices" box keeps
+    THistoryDialog(wxWindow* parent, const NCtrl::TCtrl& control, int radix1, int radix2)
+        : wxDialog(parent, wxID_ANY, wxT("Conversion history"))
+        , control(control)
+        , radix1(radix1)
+        , radix2(radix2) {
+        search = new wxTextCtrl(this, wxID_ANY);
+        search->SetHint(wxT("Search numbers"));
+        prefix = new wxCheckBox(this, wxID_ANY, wxT("Starts with"));
+        radices = new wxCheckBox(this, wxID_ANY, wxString::Format("Only %d -> %d", radix1, radix2));
+        list = new THistoryList(this, control.GetHistory());
+
+        wxBoxSizer* options = new wxBoxSizer(wxHORIZONTAL);
+        options->Add(prefix, 0, wxRIGHT, 10);
+        options->Add(radices, 0);
+        wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+        sizer->Add(new wxStaticText(this, wxID_ANY, wxT("Please select a value")), 0, wxALL, 5);
+        sizer->Add(search, 0, wxALL | wxEXPAND, 5);
+        sizer->Add(options, 0, wxALL, 5);
+        sizer->Add(list, 1, wxALL | wxEXPAND, 5);
+        sizer->Add(CreateButtonSizer(wxOK | wxCANCEL), 0, wxALL | wxEXPAND, 5);
+        SetSizerAndFit(sizer);
+
+        search->Bind(wxEVT_TEXT, [this](wxCommandEvent&) { Filter(); });
+        prefix->Bind(wxEVT_CHECKBOX, [this](wxCommandEvent&) { Filter(); });
+        radices->Bind(wxEVT_CHECKBOX, [this](wxCommandEvent&) { Filter(); });
+        list->Bind(wxEVT_LIST_ITEM_ACTIVATED, [this](wxListEvent&) { EndModal(wxID_OK); });
+        Filter();
+        search->SetFocus();
+    }
+    // History index of the chosen record, -1 when nothing is selected
+    int GetSelection() const {
+        return list->GetSelectedIndex();
+    }
+
+private:
+    void Filter() {
+        NHistory::TQuery q;
+        q.text = search->GetValue().Upper().ToStdString();
+        q.prefix = prefix->GetValue();
+        if (radices->GetValue()) {
+            q.radix1 = radix1;
+            q.radix2 = radix2;
+        }
+        list->SetRows(control.SearchHistory(q));
+    }
+
+    const NCtrl::TCtrl& control;
+    int radix1;
+    int radix2;
+    wxTextCtrl* search;
+    wxCheckBox* prefix;
+    wxCheckBox* radices;
+    THistoryList* list;
+};
 
 class Ui : public ConverterFrame {
 public:
     Ui()
-        : ConverterFrame(NULL) {
+        : ConverterFrame(NULL)
+        , converter([this](uint64_t generation, TConverted result) {
+            wxThreadEvent* event = new wxThreadEvent(EVT_CONVERTED);
+            event->SetExtraLong((long)generation);
+            event->SetPayload(result);
+            wxQueueEvent(this, event);
+        }) {
+        m_allRadices = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(-1, 240),
+                                      wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP);
+        m_allRadices->SetToolTip(wxT("Number in all radices"));
+        m_allRadices->SetFont(wxFont(wxFontInfo().Family(wxFONTFAMILY_TELETYPE)));
+        GetSizer()->Add(m_allRadices, 1, wxALL | wxEXPAND, 5);
+        GetSizer()->SetSizeHints(this);
+        Layout();
+        Bind(EVT_CONVERTED, &Ui::OnConverted, this);
+        // CALC_RECORD=<file> appends the session to file for replay_main.cc
+        if (const char* path = getenv("CALC_RECORD")) {
+            if (!recorder.Open(path)) {
+                wxLogWarning("Can't record events to '%s'", path);
+            }
+        }
     }
 
     void Init() {
+        wxString historyPath = wxStandardPaths::Get().GetUserConfigDir() + "/.radix-converter.history";
+        try {
+            size_t corrupted = Control.OpenHistoryLog(historyPath.ToStdString());
+            if (corrupted > 0) {
+                wxLogWarning("Skipped %zu corrupted history records", corrupted);
+            }
+        } catch (std::exception& e) {
+            wxLogWarning("History is not saved: %s", e.what());
+        }
         Control.SetSourceRadix(m_sourceRadix->GetValue());
         Control.SetOutputRadix(m_outputRadix->GetValue());
         Control.SetOutputPrecision(m_outputPrecision->GetSelection());
@@ -26,18 +164,11 @@ public:
 
     void OnHistory(wxCommandEvent& event) {
         wxLogDebug("Click Menu History");
-        wxArrayString choices;
-        for (auto& i : Control.GetHistory()) {
-            choices.Add(i);
-        }
+        THistoryDialog dialog(this, Control, Control.GetSourceRadix(), Control.GetOutputRadix());
 
-        wxSingleChoiceDialog dialog(this,
-                                    wxT("Conversion history"),
-                                    wxT("Please select a value"),
-                                    choices);
-
-        if (dialog.ShowModal() == wxID_OK) {
+        if (dialog.ShowModal() == wxID_OK && dialog.GetSelection() >= 0) {
             int idx = dialog.GetSelection();
+            recorder.Record(NReplay::TKind::FromHistory, std::to_string(idx));
             auto sel = Control.SetFromHistory(idx);
             wxLogDebug("Set item from history: %s", sel.ToString());
 
@@ -52,13 +183,47 @@ public:
 
     void OnAddToHistory(wxCommandEvent& event) {
         wxLogDebug("Click History");
-        Control.AddToHistory();
+        recorder.Record(NReplay::TKind::AddToHistory);
+        try {
+            Control.AddToHistory();
+        } catch (std::exception& e) {
+            wxLogWarning("History record is not saved: %s", e.what());
+        }
     }
 
+    // Renders on the worker thread through the conversion cache: a burst
+    // of edits is coalesced into one conversion of the last state and the
+    // GUI thread never waits.
     void OnSourceNumber(wxCommandEvent& event) {
-        std::string result = Control.Convert();
-        wxLogDebug("Do conversion for: %s -> %s", m_sourceNumber->GetValue(), result);
-        m_outputNumber->ChangeValue(wxString(result));
+        NCtrl::TOutput output = Control.GetOutput();
+        uint64_t generation = converter.Submit([this, output](const NWorker::TCancel& cancel) {
+            TConverted result;
+            result.output = Control.Render(output, renderer);
+            if (!cancel.IsCancelled()) {
+                result.all = output.number.ToStringAllRadices();
+            }
+            return result;
+        });
+        wxLogDebug("Queue conversion %llu for: %s", (unsigned long long)generation, m_sourceNumber->GetValue());
+    }
+
+    void OnConverted(wxThreadEvent& event) {
+        uint64_t generation = (uint64_t)event.GetExtraLong();
+        if (!converter.IsCurrent(generation)) {
+            wxLogDebug("Drop stale conversion %llu", (unsigned long long)generation);
+            return;
+        }
+        TConverted result = event.GetPayload<TConverted>();
+        m_outputNumber->ChangeValue(wxString(result.output));
+        ShowAllRadices(result.all);
+    }
+
+    void ShowAllRadices(const std::vector<std::string>& all) {
+        wxString text;
+        for (size_t i = 0; i < all.size(); i++) {
+            text += wxString::Format("%2d: %s\n", int(NConst::RADIX_MIN + i), all[i]);
+        }
+        m_allRadices->ChangeValue(text);
     }
 
     int SetPrecision() {
@@ -69,11 +234,13 @@ public:
 
     void OnPrecisionChoice(wxCommandEvent& event) {
         int p = SetPrecision();
+        recorder.Record(NReplay::TKind::Precision, std::to_string(p));
         wxLogDebug("Set output precision: '%d'", p);
         OnSourceNumber(event);
     }
 
     void OnSign(wxCommandEvent& event) {
+        recorder.Record(NReplay::TKind::Sign);
         Control.AddSign();
         m_sourceNumber->ChangeValue(wxString(Control.GetSourceNumberAsStr()));
         OnSourceNumber(event);
@@ -83,14 +250,17 @@ public:
         try {
             Control.AddDot();
             m_sourceNumber->ChangeValue(wxString(Control.GetSourceNumberAsStr()));
-            SetPrecision();
+            int p = SetPrecision();
+            recorder.Record(NReplay::TKind::Dot, std::to_string(p));
         } catch (NCtrl::invalid_digit& e) {
+            recorder.Record(NReplay::TKind::Dot);
             wxLogDebug("Failed to add dot: %s", e.what());
         }
     }
 
     void OnBackspace(wxCommandEvent& event) {
         wxLogDebug("Click on backspace button");
+        recorder.Record(NReplay::TKind::Backspace);
         Control.Backspace();
         m_sourceNumber->ChangeValue(wxString(Control.GetSourceNumberAsStr()));
         OnSourceNumber(event);
@@ -98,20 +268,25 @@ public:
 
     void OnClear(wxCommandEvent& WXUNUSED(event)) {
         wxLogDebug("Click on clear button");
+        recorder.Record(NReplay::TKind::Clear);
         Control.Clear();
+        converter.Submit([](const NWorker::TCancel&) { return TConverted(); });
         m_sourceNumber->ChangeValue(wxT(""));
         m_outputNumber->ChangeValue(wxT(""));
+        m_allRadices->ChangeValue(wxT(""));
     }
 
     void OnSliderOutputRadix(wxCommandEvent& event) {
         int outputRadix = m_outputRadix->GetValue();
         wxLogDebug("Set output radix = %d", outputRadix);
+        recorder.Record(NReplay::TKind::OutputRadix, std::to_string(outputRadix));
         Control.SetOutputRadix(outputRadix);
         OnSourceNumber(event);
     }
 
     void OnSliderSourceRadix(wxCommandEvent& WXUNUSED(event)) {
         int sourceRadix = m_sourceRadix->GetValue();
+        recorder.Record(NReplay::TKind::SourceRadix, std::to_string(sourceRadix));
         try {
             Control.SetSourceRadix(sourceRadix);
             // convert source number to valid and reset ui text
@@ -137,6 +312,7 @@ public:
         wxButton* nb = (wxButton*)wxWindow::FindWindowById(id);
         char n = nb->GetLabel().ToStdString()[0];
         wxLogDebug("Click on %c", n);
+        recorder.Record(NReplay::TKind::Digit, std::string(1, n));
 
         try {
             Control.AddDigit(n);
@@ -160,6 +336,7 @@ public:
     void OnSourceNumberTextUpdate(wxCommandEvent& event) {
         std::string inStr = m_sourceNumber->GetValue().ToStdString();
         wxLogDebug("Process string: '%s'", inStr);
+        recorder.Record(NReplay::TKind::Text, inStr);
         std::string tmp = inStr;
         bool ok = false;
         try {
@@ -182,6 +359,10 @@ public:
 
 private:
     NCtrl::TCtrl Control;
+    // used by converter jobs only, on the worker thread
+    NCtrl::TRenderer renderer;
+    wxTextCtrl* m_allRadices;
+    NReplay::TRecorder recorder;
     std::vector<wxButton*> numbers = {
         m_button0,
         m_button1,
@@ -200,6 +381,8 @@ private:
         m_buttonE,
         m_buttonF,
     };
+    // last, so that its thread stops before the members above go away
+    NWorker::TLatestWorker<TConverted> converter;
 };
 
 #endif // #ifndef UI_UI_CC
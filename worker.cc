@@ -0,0 +1,189 @@
+#ifndef WORKER_CC
+#define WORKER_CC
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Background thread that only ever works on the newest request.
+namespace NWorker {
+    // Passed to a job: true once a newer job was submitted, a long job
+    // may poll it and return early, its result is dropped anyway.
+    class TCancel {
+    public:
+        TCancel(const std::atomic<uint64_t>& latest, uint64_t generation)
+            : latest(latest)
+            , generation(generation) {
+        }
+        bool IsCancelled() const {
+            return latest.load(std::memory_order_acquire) != generation;
+        }
+
+    private:
+        const std::atomic<uint64_t>& latest;
+        const uint64_t generation;
+    };
+
+    // Submit() numbers jobs with a generation counter and replaces the
+    // pending job, so a burst of requests costs one run of the last one.
+    // done(generation, result) is called on the worker thread for jobs
+    // not superseded while running; a receiver on another thread should
+    // still compare the generation with IsCurrent() when it gets it.
+    template <typename TResult>
+    class TLatestWorker {
+    public:
+        using TJob = std::function<TResult(const TCancel&)>;
+        using TDone = std::function<void(uint64_t, TResult)>;
+
+        explicit TLatestWorker(TDone done)
+            : done(std::move(done))
+            , thread(&TLatestWorker::Loop, this) {
+        }
+        ~TLatestWorker() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop = true;
+                generation.fetch_add(1, std::memory_order_acq_rel); // cancel the running job
+            }
+            wakeup.notify_one();
+            thread.join();
+        }
+
+        uint64_t Submit(TJob job) {
+            uint64_t g;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                g = generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+                if (pending) {
+                    skipped++;
+                }
+                pending = std::move(job);
+                pendingGeneration = g;
+            }
+            wakeup.notify_one();
+            return g;
+        }
+
+        uint64_t GetGeneration() const {
+            return generation.load(std::memory_order_acquire);
+        }
+        bool IsCurrent(uint64_t g) const {
+            return g == GetGeneration();
+        }
+        // Jobs replaced by a newer one before they started or finished.
+        uint64_t GetSkipped() const {
+            return skipped.load(std::memory_order_relaxed);
+        }
+        // Jobs whose result was delivered.
+        uint64_t GetDone() const {
+            return delivered.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void Loop() {
+            std::unique_lock<std::mutex> guard(lock);
+            while (true) {
+                wakeup.wait(guard, [this] { return stop || pending; });
+                if (stop) {
+                    return;
+                }
+                TJob job = std::move(pending);
+                pending = nullptr;
+                uint64_t g = pendingGeneration;
+                guard.unlock();
+
+                TCancel cancel(generation, g);
+                try {
+                    TResult result = job(cancel);
+                    if (cancel.IsCancelled()) {
+                        skipped++;
+                    } else {
+                        done(g, std::move(result));
+                        delivered++;
+                    }
+                } catch (...) {
+                    skipped++;
+                }
+                guard.lock();
+            }
+        }
+
+        TDone done;
+        std::mutex lock;
+        std::condition_variable wakeup;
+        TJob pending;
+        uint64_t pendingGeneration = 0;
+        bool stop = false;
+        std::atomic<uint64_t> generation{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<uint64_t> delivered{0};
+        // last, started once everything above is initialised
+        std::thread thread;
+    };
+} // namespace NWorker
+
+#ifdef RUN_TESTS
+#include "acutest.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+void test_worker() {
+    using namespace NWorker;
+
+    TEST_CASE("Burst is coalesced to the last job");
+    {
+        std::mutex lock;
+        std::vector<std::pair<uint64_t, std::string>> results;
+        std::atomic<bool> started{false};
+        std::atomic<bool> release{false};
+        {
+            TLatestWorker<std::string> w([&](uint64_t g, std::string r) {
+                std::lock_guard<std::mutex> guard(lock);
+                results.push_back({g, r});
+            });
+            // the first job blocks until the burst is submitted and is
+            // cancelled by it
+            std::atomic<bool> sawCancel{false};
+            w.Submit([&](const TCancel& c) {
+                started = true;
+                while (!release.load()) {
+                    std::this_thread::yield();
+                }
+                sawCancel = c.IsCancelled();
+                return std::string("first");
+            });
+            while (!started.load()) {
+                std::this_thread::yield();
+            }
+            uint64_t last = 0;
+            for (int i = 0; i < 100; i++) {
+                last = w.Submit([i](const TCancel&) { return std::to_string(i); });
+            }
+            release = true;
+            while (w.GetDone() + w.GetSkipped() < 101) {
+                std::this_thread::yield();
+            }
+            TEST_CHECK(sawCancel);
+            TEST_CHECK(w.IsCurrent(last) && w.GetDone() == 1);
+            std::lock_guard<std::mutex> guard(lock);
+            TEST_CHECK(results.size() == 1 && results[0].first == last && results[0].second == "99");
+        }
+    }
+    TEST_CASE("Throwing job is skipped");
+    {
+        std::atomic<int> calls{0};
+        TLatestWorker<int> w([&](uint64_t, int) { calls++; });
+        w.Submit([](const TCancel&) -> int { throw std::runtime_error("boom"); });
+        w.Submit([](const TCancel&) { return 1; });
+        while (w.GetDone() == 0) {
+            std::this_thread::yield();
+        }
+        TEST_CHECK(calls == 1);
+    }
+}
+#endif // #ifdef RUN_TESTS
+#endif // #ifndef WORKER_CC